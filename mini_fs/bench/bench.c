@@ -0,0 +1,310 @@
+#define _GNU_SOURCE     /* F_SETPIPE_SZ */
+/*─────────────────────────────────────────────────────────────*/
+/*  Microbenchmarks dos caminhos quentes (make bench)          */
+/*                                                             */
+/*  Cada caso roda `warmup` amostras descartadas e depois      */
+/*  `samples` amostras cronometradas; uma amostra executa      */
+/*  `ops` operações. O resultado (ns/op: mín, p50, p90, p99,   */
+/*  máx, média e MB/s na mediana) vai para um JSON, para       */
+/*  comparar commits.                                          */
+/*─────────────────────────────────────────────────────────────*/
+#include "block.h"
+#include "fs.h"
+#include "auth.h"
+#include "directory.h"
+#include "session.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef BENCH_OPT
+#define BENCH_OPT ""                   /* flags de otimização do build */
+#endif
+
+#define FS_BLOCKS   (1u << 18)         /* 1 GiB de capacidade (reserva) */
+#define ALLOC_CAP   (1u << 16)         /* blocos no teste do alocador   */
+#define ALLOC_BATCH 256                /* > magazine: força refill/drain */
+
+typedef struct {
+    const char *name;
+    size_t      ops;                   /* operações por amostra          */
+    size_t      bytes;                 /* bytes por amostra (0 = n/a)    */
+    int         warmup, samples;
+    void      (*setup)(void);          /* antes de cada amostra, fora do tempo */
+    void      (*run)(void);
+} Bench;
+
+static FILE *_json;
+static int   _nres;
+static bool  _quick;                   /* -q: poucas amostras (CI)       */
+
+/*──────────────── cronômetro ──────────────────────────────*/
+static inline uint64_t _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int _cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double _pct(const double *v, int n, double p)
+{
+    int i = (int)(p * (n - 1) + 0.5);
+    return v[i];
+}
+
+static void _run(const Bench *b)
+{
+    int samples = _quick ? (b->samples + 4) / 5 : b->samples;
+    if (samples < 3) samples = 3;
+    double *ns = g_new(double, samples);
+
+    for (int i = -b->warmup; i < samples; ++i) {
+        if (b->setup) b->setup();
+        uint64_t t0 = _now();
+        b->run();
+        uint64_t dt = _now() - t0;
+        if (i >= 0) ns[i] = (double)dt / (double)b->ops;
+    }
+
+    double sum = 0;
+    for (int i = 0; i < samples; ++i) sum += ns[i];
+    qsort(ns, samples, sizeof *ns, _cmp);
+    double p50 = _pct(ns, samples, .50);
+
+    fprintf(_json, "%s\n    { \"name\": \"%s\", \"samples\": %d, \"ops\": %zu,\n"
+                   "      \"ns_per_op\": { \"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f,"
+                   " \"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f }",
+            _nres++ ? "," : "", b->name, samples, b->ops,
+            ns[0], p50, _pct(ns, samples, .90), _pct(ns, samples, .99),
+            ns[samples - 1], sum / samples);
+    if (b->bytes)
+        fprintf(_json, ",\n      \"mb_per_s\": %.1f",
+                (double)b->bytes / b->ops / p50 * 1e9 / (1 << 20));
+    fputs(" }", _json);
+
+    fprintf(stderr, "  %-28s p50 %10.1f ns/op   p99 %10.1f ns/op\n",
+            b->name, p50, _pct(ns, samples, .99));
+    g_free(ns);
+}
+
+/*──────────────── block_alloc ─────────────────────────────*/
+/* alocação + liberação em lotes maiores que a magazine, sobre um
+ * bitmap já ocupado até a fração pedida                            */
+static int _batch[ALLOC_BATCH];
+
+static void _alloc_fill(double frac)
+{
+    block_init(ALLOC_CAP, BLOCK_SIZE_DFLT, 0);
+    for (size_t left = (size_t)(frac * ALLOC_CAP), got; left; left -= got)
+        if (block_alloc_range(left, &got) < 0) break;
+}
+
+static void b_alloc(void)
+{
+    for (int i = 0; i < ALLOC_BATCH; ++i) _batch[i] = block_alloc();
+    for (int i = 0; i < ALLOC_BATCH; ++i) block_free(_batch[i]);
+}
+
+static void bench_block(void)
+{
+    static const struct { const char *name; double frac; } lv[] = {
+        { "block_alloc/fill0",  0.00 }, { "block_alloc/fill50", 0.50 },
+        { "block_alloc/fill90", 0.90 }, { "block_alloc/fill99", 0.99 },
+    };
+    for (size_t i = 0; i < sizeof lv / sizeof *lv; ++i) {
+        _alloc_fill(lv[i].frac);
+        _run(&(Bench){ lv[i].name, 2 * ALLOC_BATCH, 0, 50, 500, NULL, b_alloc });
+    }
+}
+
+/*──────────────── fs_echo (append) ────────────────────────*/
+#define ECHO_SMALL   64
+#define ECHO_LARGE   (1u << 20)
+#define ECHO_NSMALL  4096
+#define ECHO_NLARGE  16
+
+static char *_small, *_large;
+
+static void s_fresh(void) { fs_rm("/echo"); fs_touch("/echo"); }
+static void b_echo_small(void) { for (int i = 0; i < ECHO_NSMALL; ++i) fs_echo("/echo", _small, 1); }
+static void b_echo_large(void) { for (int i = 0; i < ECHO_NLARGE; ++i) fs_echo("/echo", _large, 1); }
+
+static void bench_echo(void)
+{
+    _small = g_malloc(ECHO_SMALL + 1); memset(_small, 's', ECHO_SMALL); _small[ECHO_SMALL] = 0;
+    _large = g_malloc(ECHO_LARGE + 1); memset(_large, 'L', ECHO_LARGE); _large[ECHO_LARGE] = 0;
+    _run(&(Bench){ "fs_echo/append64",  ECHO_NSMALL, ECHO_NSMALL * ECHO_SMALL,
+                   3, 30, s_fresh, b_echo_small });
+    _run(&(Bench){ "fs_echo/append1M",  ECHO_NLARGE, (size_t)ECHO_NLARGE * ECHO_LARGE,
+                   2, 20, s_fresh, b_echo_large });
+    fs_rm("/echo");
+}
+
+/*──────────────── fs_cat / fs_cp ──────────────────────────*/
+#define BIG_FILE  (64u << 20)
+
+static void b_cat(void) { fs_cat("/big"); }
+static void s_nocopy(void) { fs_rm("/big2"); }
+static void b_cp(void)  { fs_cp("/big", "/big2"); }
+
+static void bench_stream(void)
+{
+    fs_touch("/big");
+    for (size_t off = 0; off < BIG_FILE; off += ECHO_LARGE)
+        fs_pwrite("/big", _large, ECHO_LARGE, off);
+    _run(&(Bench){ "fs_cat/64M",  1, BIG_FILE, 2, 20, NULL, b_cat });
+    _run(&(Bench){ "fs_cp/64M",   1, BIG_FILE, 2, 20, s_nocopy, b_cp });
+    fs_rm("/big2");
+    fs_rm("/big");
+}
+
+/*──────────────── _resolve (caminhos profundos) ───────────*/
+#define RESOLVE_N 1000
+
+static char _deep16[256], _deep128[1024];
+
+static void b_res16(void)  { for (int i = 0; i < RESOLVE_N; ++i) dir_cd(_deep16); }
+static void b_res128(void) { for (int i = 0; i < RESOLVE_N; ++i) dir_cd(_deep128); }
+
+static void bench_resolve(void)
+{
+    char *p = _deep128;
+    for (int d = 0; d < 128; ++d) {
+        p += sprintf(p, "/d%d", d);
+        dir_mkdir(_deep128);
+        if (d == 15) strcpy(_deep16, _deep128);
+    }
+    _run(&(Bench){ "resolve/depth16",  RESOLVE_N, 0, 5, 100, NULL, b_res16 });
+    _run(&(Bench){ "resolve/depth128", RESOLVE_N, 0, 5, 100, NULL, b_res128 });
+    dir_cd("/");
+}
+
+/*──────────────── dir_ls em pasta enorme ──────────────────*/
+#define LS_FILES 100000
+
+static void b_ls(void)  { dir_ls(FALSE); }
+static void b_lsl(void) { dir_ls(TRUE); }
+
+static void bench_ls(void)
+{
+    dir_mkdir("/wide");
+    dir_cd("/wide");
+    char name[32];
+    for (int i = 0; i < LS_FILES; ++i) { sprintf(name, "f%06d", i); fs_touch_at(NULL, name); }
+    _run(&(Bench){ "dir_ls/100k",    LS_FILES, 0, 2, 20, NULL, b_ls });
+    _run(&(Bench){ "dir_ls/100k-l",  LS_FILES, 0, 2, 20, NULL, b_lsl });
+    dir_cd("/");
+}
+
+/*──────────────── auth_has_perm_mode ──────────────────────*/
+#define PERM_GROUPS 1024
+#define PERM_N      100000
+
+static volatile bool _sink;
+
+static void b_perm_in(void)
+{ for (int i = 0; i < PERM_N; ++i) _sink = auth_has_perm_mode(1, 20000 + (i & (PERM_GROUPS - 1)), 0070, P_READ); }
+static void b_perm_out(void)
+{ for (int i = 0; i < PERM_N; ++i) _sink = auth_has_perm_mode(1, 90000 + (i & 1023), 0004, P_READ); }
+
+static void bench_perm(void)
+{
+    char g[32];
+    for (int i = 0; i < PERM_GROUPS; ++i) { sprintf(g, "bg%d", i); auth_groupadd(g, 20000 + i, 0); }
+    auth_useradd("bench", 5000, 20000, "x", 0644);
+    for (int i = 0; i < PERM_GROUPS; ++i) { sprintf(g, "bg%d", i); auth_add_user_to_group("bench", g); }
+
+    Session *s = session_new(5000, 20000), *old = session_use(s);
+    _run(&(Bench){ "perm/1024groups-member", PERM_N, 0, 5, 100, NULL, b_perm_in });
+    _run(&(Bench){ "perm/1024groups-other",  PERM_N, 0, 5, 100, NULL, b_perm_out });
+    session_use(old);
+    session_free(s);
+}
+
+/*──────────────── saída padrão ────────────────────────────*/
+/* cat e ls escrevem em stdout: um pipe drenado por outra thread
+ * (como "mfs | consumidor"); /dev/null descartaria sem copiar      */
+static int _drain_fd;
+
+static gpointer _drain(gpointer unused)
+{
+    (void)unused;
+    static char sink[1 << 16];
+    while (read(_drain_fd, sink, sizeof sink) > 0) ;
+    return NULL;
+}
+
+static GThread *_stdout_to_pipe(void)
+{
+    int p[2];
+    if (pipe(p)) return NULL;
+    fcntl(p[1], F_SETPIPE_SZ, 1 << 20);
+    _drain_fd = p[0];
+    dup2(p[1], STDOUT_FILENO);
+    close(p[1]);
+    return g_thread_new("drain", _drain, NULL);
+}
+
+/*─────────────────────────────────────────────────────────────*/
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Uso: %s [-o saída.json] [-r revisão] [-q]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = "bench.json", *rev = "";
+    int opt;
+    while ((opt = getopt(argc, argv, "o:r:q")) != -1) {
+        switch (opt) {
+        case 'o': out = optarg;   break;
+        case 'r': rev = optarg;   break;
+        case 'q': _quick = true;  break;
+        default:  usage(argv[0]); return 2;
+        }
+    }
+    if (!(_json = fopen(out, "w"))) { perror(out); return 1; }
+
+    GThread *drain = _stdout_to_pipe();
+    if (!drain) { perror("pipe"); return 1; }
+
+    time_t now = time(NULL);
+    char date[32];
+    strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(_json, "{\n  \"rev\": \"%s\", \"date\": \"%s\", \"cpus\": %u,"
+                   " \"opt\": \"%s\",\n  \"results\": [",
+            rev, date, g_get_num_processors(), BENCH_OPT);
+
+    auth_init();
+    fprintf(stderr, "bench → %s\n", out);
+    bench_block();
+
+    auth_set_uid(0); auth_set_gid(0);            /* root: sem checagens */
+    if (fs_init(NULL, FS_BLOCKS, BLOCK_SIZE_DFLT, 0)) { fputs("fs_init\n", stderr); return 1; }
+    bench_echo();
+    bench_stream();
+    bench_resolve();
+    bench_ls();
+    bench_perm();
+    fs_shutdown();
+
+    fflush(stdout);
+    close(STDOUT_FILENO);                        /* EOF para o dreno */
+    g_thread_join(drain);
+    close(_drain_fd);
+
+    fputs("\n  ]\n}\n", _json);
+    fclose(_json);
+    g_free(_small); g_free(_large);
+    return 0;
+}
@@ -25,12 +25,15 @@ typedef struct {
 
 /* ───── sessão atual ─────────────────────────────────────── */
 bool      auth_login(void);           /* prompt    */
+bool      auth_authenticate(const char *name,const char *pass); /* sem prompt */
 void      auth_logout(void);
 bool      auth_is_admin(void);        /* uid==0    */
 uint32_t  auth_uid(void);
 uint32_t  auth_gid(void);
 void      auth_set_uid(uint32_t uid); /* su        */
 void      auth_set_gid(uint32_t gid); /* sg        */
+struct session;
+void      auth_session_sync(struct session *s); /* gids após mudanças no banco */
 
 /* ───── CRUD usuários / grupos ───────────────────────────── */
 int  auth_groupadd (const char *name,uint32_t gid,uint16_t perm);
@@ -38,13 +41,17 @@ int  auth_useradd  (const char *name,uint32_t uid,uint32_t gid,
                     const char *pwd,uint16_t def_perms);
 int  auth_delete_user(const char *name);
 int  auth_add_user_to_group(const char *user,const char *group);
+int  auth_join_group(uint32_t uid,const char *group);  /* joingroup */
 int  auth_set_user_perms(const char *name,uint16_t perms);
+int  auth_set_class_perms(uint32_t uid,int shift,uint16_t bits); /* → novas */
 
 /* ───── pesquisa ─────────────────────────────────────────── */
-User  *auth_get_user(const char *name);
-User  *auth_get_user_by_uid(uint32_t uid);
-Group *auth_get_group(const char *name);
+/* cópias feitas sob a trava do banco (um userdel em outra sessão não as
+ * invalida); out pode ser NULL; out->name / passwd ficam NULL          */
+bool   auth_get_user(const char *name,User *out);
+bool   auth_get_user_by_uid(uint32_t uid,User *out);
 int    auth_get_gid_by_name(const char *name,uint32_t *out_gid);
+bool   auth_check_passwd(const char *name,const char *pass);
 
 /* ───── permissões ───────────────────────────────────────── */
 bool auth_has_perm     (const FCB *f,uint16_t bit);        /* arquivo */
@@ -8,15 +8,43 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-/* Tamanho de cada bloco (bytes) e quantidade total de blocos ------------- */
-#define BLOCK_SIZE   4096          /* 4 KiB              */
-#define BLOCK_COUNT  1024          /* 4 MiB (1024×4 KiB) */
+/* Valores-padrão de tamanho de bloco e capacidade (ver block_init) ------- */
+#define BLOCK_SIZE_DFLT   4096     /* 4 KiB              */
+#define BLOCK_COUNT_DFLT  1024     /* 4 MiB (1024×4 KiB) */
+#define BLOCK_GROW_CHUNK  256      /* blocos liberados por expansão */
+#define BLOCK_SHARDS      16       /* fatias do bitmap (dica própria) */
+#define BLOCK_MAG_SIZE    64       /* blocos na magazine de cada thread */
+#define BLOCK_MAG_BATCH   32       /* reposição / devolução por lote  */
+#define BLOCK_FRAG_SLOTS  64       /* fatias por bloco de fragmentos  */
+#define BLOCK_FRAG_SCAN   64       /* blocos olhados antes de abrir outro */
+
+/* flags de block_init ---------------------------------------------------- */
+#define BLOCK_F_HUGEPAGE  0x1      /* pede transparent huge pages   */
 
 /* API pública ------------------------------------------------------------- */
-void     block_init(void);
+int      block_init(size_t capacity,
+                    size_t block_size,
+                    unsigned flags);              /* 0 ou −1 (parâm. inválido)  */
+
+/* usa área de dados, bitmap (1 bit/bloco) e refcounts fornecidos (volume.c);
+ * a capacidade é fixa e os sumários são reconstruídos a partir do bitmap.
+ * recover: devolve ao bitmap blocos com refcount 0 (liberações pendentes) */
+int      block_attach(void *data, uint64_t *bitmap, uint32_t *refs,
+                      size_t capacity, size_t block_size, bool recover);
 
+/* blocos novos NÃO são zerados: o conteúdo é o que o último dono deixou */
 int      block_alloc(void);                       /* retorna índice (0+) ou −1  */
-void     block_free(int index);
+void     block_free(int index);                   /* solta 1 referência         */
+
+/* faixa contígua de até `want` blocos; *got recebe quantos vieram (≥1) */
+int      block_alloc_range(size_t want, size_t *got);
+void     block_free_range(int start, size_t n);
+void     block_release_pending(void);             /* após commit do journal     */
+void     block_flush_caches(void);                /* magazines → bitmap         */
+
+/* referências p/ compartilhar blocos entre arquivos (cp copy-on-write) --- */
+int      block_ref_range(int start, size_t n);    /* +1 em cada; 0 ou −1        */
+uint32_t block_refcount(int index);               /* 0 = livre                  */
 
 size_t   block_write(int index,
                      const void *buf,
@@ -28,6 +56,47 @@ size_t   block_read(int index,
                     size_t len,
                     size_t offset);               /* bytes realmente lidos      */
 
+/* variantes p/ faixas contíguas: um único memcpy por faixa --------------- */
+size_t   block_write_run(int start, size_t nblk,
+                         const void *buf, size_t len, size_t offset);
+size_t   block_read_run (int start, size_t nblk,
+                         void *buf, size_t len, size_t offset);
+int      block_copy(int dst, int src, size_t nblk);  /* 0 ou −1        */
+
+/* fragmentos: pedaços de até meio bloco (caudas de arquivos) dentro de
+ * blocos compartilhados; a capacidade é uma potência de 2 de fatias
+ * (bloco/BLOCK_FRAG_SLOTS) ≥ len. Devolve o bloco (off/cap em bytes)
+ * ou −1. Os dados são lidos/escritos com block_data/block_write      */
+int      block_frag_alloc(size_t len, uint32_t *off, uint32_t *cap);
+void     block_frag_free (int blk, uint32_t off, uint32_t cap);
+int      block_frag_claim(int blk, uint32_t off, uint32_t cap); /* montagem */
+
+/* blocos comprimidos: o conteúdo de um bloco inteiro, passado pelo lz.h,
+ * num fragmento de nº exato de fatias de um contêiner de BLOCK_ZRUN
+ * blocos contíguos. O id (bit BLOCK_Z) codifica contêiner, 1ª fatia e nº
+ * de fatias e ocupa o lugar do bloco no mapa de extents; ids seguidos
+ * não são fragmentos vizinhos. A leitura descomprime num cache de
+ * BLOCK_ZCACHE blocos, em BLOCK_ZSHARDS fatias com trava própria. Só
+ * contêineres < BLOCK_Z_BLKS servem (8 GiB com blocos de 4 KiB)       */
+#define BLOCK_Z           0x80000000u
+#define BLOCK_Z_BLKS      (1u << 21)
+#define BLOCK_ZRUN        4        /* blocos por contêiner de comprimidos */
+#define BLOCK_ZCACHE      16       /* blocos descomprimidos em memória */
+#define BLOCK_ZSHARDS     4        /* travas do cache (por id)         */
+
+uint32_t block_zpack (int index);     /* id novo ou 0 (não compensa/sem espaço) */
+size_t   block_zread (uint32_t id, void *buf, size_t len, size_t offset);
+void     block_zfree (uint32_t id);
+uint32_t block_zdup  (uint32_t id);   /* cópia em fragmento próprio; id ou 0 */
+int      block_zclaim(uint32_t id);   /* montagem; 0 ou −1                   */
+
+/* ponteiro p/ os dados de uma faixa (NULL se inválida); vale até a faixa
+ * ser liberada – o store nunca muda de endereço                          */
+const void *block_data(int start, size_t nblk);
+
 bool     block_is_free(int index);
+size_t   block_free_count(void);                  /* livres + magazines; O(1)       */
+size_t   block_size(void);                        /* bytes por bloco            */
+size_t   block_capacity(void);                    /* limite de blocos           */
 
 #endif /* BLOCK_H */
@@ -13,6 +13,8 @@
 #define P_WRITE  2
 #define P_EXEC   1
 
+#define DIR_NAME_MAX  63        /* maior nome de arquivo/diretório   */
+
 typedef struct dir_node {
     /* ─── segurança ───────────────────────────────────────── */
     uint32_t            owner;          /* UID do criador            */
@@ -24,16 +26,32 @@ typedef struct dir_node {
     struct dir_node    *parent;         /* NULL na raiz “/”          */
     GTree              *subdirs;        /* <nome,Dir*> ordenado      */
     GHashTable         *files;          /* <nome,FCB*> (fs.c)        */
+    GRWLock             lock;           /* protege subdirs e files   */
+
+    /* ─── persistência ────────────────────────────────────── */
+    uint32_t            ino;            /* slot na tabela do volume  */
+
+    /* ─── cache de resolução ──────────────────────────────── */
+    gint                x_tok;          /* ficha da sessão que passou
+                                           no X (ver session.h)      */
 } Dir;
 
 /* ─── API ────────────────────────────────────────────────── */
 void        dir_init   (void);                    /* cria raiz              */
-int         dir_mkdir  (const char *name);        /* mkdir                  */
+int         dir_mount  (void);                    /* árvore a partir do vol.*/
+int         dir_mkdir  (const char *path);        /* mkdir [a/b/]novo       */
 int         dir_cd     (const char *path);        /* cd / a/../x            */
 void        dir_ls     (gboolean long_fmt);       /* ls / ls -l             */
 const char *dir_pwd    (char *buf,size_t n);      /* caminho textual        */
 
-Dir        *dir_get_cwd(void);                    /* CWD p/ fs.c            */
+Dir        *dir_get_cwd(void);                    /* CWD da sessão p/ fs.c  */
+/* diretório de `path` a partir de base (NULL = cwd; '/' = raiz), com X em
+ * cada passo; NULL se não existe ou sem permissão. Usa o cache.          */
+Dir        *dir_resolve(Dir *base,const char *path);
 bool        dir_has_perm(const Dir *d,uint16_t bit);/* checagem de permissão */
 
+/* invalida o cache de caminhos de todas as sessões: mudou a árvore ou
+ * permissões (credenciais são por sessão e invalidam só a própria)      */
+void        dir_invalidate(void);
+
 #endif /* DIRECTORY_H */
\ No newline at end of file
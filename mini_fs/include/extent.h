@@ -0,0 +1,39 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+/*───────────────────────────────────────────────────────────*/
+/*  Mapa de extents – bloco lógico → faixa de blocos físicos */
+/*───────────────────────────────────────────────────────────*/
+#include <stdint.h>
+#include <stddef.h>
+#include <glib.h>
+
+typedef struct {
+    uint32_t lblk;                  /* 1º bloco lógico do trecho       */
+    uint32_t pblk;                  /* 1º bloco físico correspondente  */
+    uint32_t len;                   /* blocos contíguos                */
+} Extent;
+
+#define EXT_HOLE  UINT32_MAX        /* pblk devolvido p/ trecho sem bloco */
+/* pblk com BLOCK_Z (block.h) é um bloco comprimido; aqui só há aritmética */
+
+/* libera `n` blocos físicos a partir de `pblk` (ext_punch) */
+typedef void (*ExtReleaseFn)(uint32_t pblk, uint32_t n);
+
+/* ─── API ────────────────────────────────────────────────── */
+GArray  *ext_new   (void);                        /* GArray<Extent> vazio   */
+void     ext_free  (GArray *map);
+
+uint32_t ext_blocks(const GArray *map);           /* total de blocos mapeados */
+uint32_t ext_end   (const GArray *map);           /* 1º lógico após o último  */
+
+/* trecho contíguo a partir de `lblk`: devolve o comprimento e o físico
+ * inicial em *pblk (EXT_HOLE se não mapeado; após o fim → UINT32_MAX) */
+uint32_t ext_find  (const GArray *map, uint32_t lblk, uint32_t *pblk);
+
+/* mapeia [lblk, lblk+n) → [pblk, pblk+n); a faixa lógica deve estar livre */
+void     ext_insert(GArray *map, uint32_t lblk, uint32_t pblk, uint32_t n);
+
+/* desfaz o mapeamento de [lblk, lblk+n), chamando `release` p/ cada pedaço */
+void     ext_punch (GArray *map, uint32_t lblk, uint32_t n, ExtReleaseFn release);
+
+#endif /* EXTENT_H */
@@ -6,9 +6,12 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <time.h>
+#include <sys/types.h>                       /* ssize_t */
+#include <sys/uio.h>                         /* iovec   */
 #include <glib.h>
 #include "directory.h"
 #include "block.h"
+#include "extent.h"
 
 /* ───── bits de permissão ─────
  *            rwx rwx rwx
@@ -20,8 +23,13 @@
 
 typedef enum { F_DATA = 0, F_PROGRAM = 1 } ftype_t;
 
+/* arquivos de até FS_INLINE_MAX bytes guardam os dados no próprio FCB
+ * (e no inode do volume), sem bloco nem mapa de extents               */
+#define FS_INLINE_MAX  120
+
 typedef struct fcb {
     char      *name;                        /* cópia alocada            */
+    Dir       *dir;                         /* diretório que o contém   */
     uint32_t   inode;
     uint32_t   owner;                       /* UID do criador           */
     uint32_t   group;                       /* GID primário do criador  */
@@ -29,18 +37,84 @@ typedef struct fcb {
     ftype_t    type;
     time_t     created, modified, accessed;
     uint16_t   perms;                       /* 9 bits rwxrwxrwx          */
-    GPtrArray *blocks;                      /* vetor de índices físicos */
+    GArray    *extents;                     /* <Extent>; NULL = inline  */
+    uint8_t    inl[FS_INLINE_MAX];          /* dados inline; 0 após size */
+    uint32_t   tail_blk;                    /* cauda num fragmento:      */
+    uint32_t   tail_off, tail_cap;          /* cap 0 = sem (block_frag_*) */
+    bool       zip;                         /* comprime blocos selados  */
+    GRWLock    lock;                        /* dados, mapa e atributos  */
+    gint       refs;                        /* pasta + handles + ops    */
 } FCB;
 
+/* flags de fs_init (as demais vão para block_init) ------------------ */
+#define FS_F_ZIP     0x100        /* arquivos novos nascem comprimidos   */
+
+/* flags de fs_open ---------------------------------------------------- */
+#define FS_O_RDONLY  0x01
+#define FS_O_WRONLY  0x02
+#define FS_O_RDWR    (FS_O_RDONLY | FS_O_WRONLY)
+#define FS_O_CREAT   0x04         /* cria se não existe                  */
+#define FS_O_TRUNC   0x08         /* zera o tamanho ao abrir p/ escrita  */
+#define FS_O_APPEND  0x10         /* toda escrita vai para o fim         */
+
 /* ───── API ───── */
-void fs_init(void);
+/* image == NULL → volume só em memória (ver block_init); senão monta ou
+ * formata a imagem persistente (ver vol_open)                           */
+int  fs_init(const char *image, size_t nblocks, size_t block_sz, unsigned flags);
+int  fs_sync(void);                              /* msync da imagem       */
+void fs_shutdown(void);                          /* desmonta a imagem     */
+int  fs_mount_file(Dir *parent, uint32_t ino);   /* usado por dir_mount   */
+void fs_fcb_release(FCB *f);                     /* saiu da pasta         */
 
-int  fs_touch (const char *name);
-int  fs_echo  (const char *name, const char *txt, int append);
-int  fs_cat   (const char *name);
-int  fs_rm    (const char *name);
+/* caminhos absolutos ou relativos ao cwd ("a/b/arq", "/x/arq") -------- */
+int  fs_touch (const char *path);
+int  fs_echo  (const char *path, const char *txt, int append);
+int  fs_cat   (const char *path);
+/* E/S binária posicional: bytes transferidos (0 = EOF) ou −1          */
+ssize_t fs_pread (const char *path, void *buf, size_t len, size_t off);
+ssize_t fs_pwrite(const char *path, const void *buf, size_t len, size_t off);
+/* leitura sem cópia: iovecs apontam para o block store (válidos até a
+ * próxima alteração do arquivo); retorna iovecs usados, *nbytes = bytes;
+ * cat, read_iov e sendfile dão -1 num bloco comprimido que não descomprime */
+int     fs_read_iov(const char *path, size_t off, size_t len,
+                    struct iovec *iov, int iovcnt, size_t *nbytes);
+ssize_t fs_sendfile(int fd, const char *path, size_t off, size_t len); /* writev */
+int  fs_truncate (const char *path, size_t size);            /* solta a cauda */
+int  fs_fallocate(const char *path, size_t off, size_t len); /* reserva já    */
+int  fs_rm    (const char *path);
 int  fs_cp    (const char *src,  const char *dst);
-int  fs_mv    (const char *src,  const char *dst);
-int  fs_chmod (const char *name, uint16_t new_mode);
+int  fs_mv    (const char *src,  const char *dst);           /* até entre dirs */
+int  fs_chmod (const char *path, uint16_t new_mode);
+/* blocos selados (cheios, antes do último) guardados comprimidos; ligar
+ * comprime os que já existem, desligar descomprime tudo              */
+int  fs_compress(const char *path, bool on);
+
+/* variantes *_at: caminhos relativos a `dir` (resolvido uma vez com
+ * dir_resolve); dir == NULL → cwd; caminho absoluto ignora `dir`        */
+int     fs_touch_at    (Dir *dir, const char *path);
+int     fs_echo_at     (Dir *dir, const char *path, const char *txt, int append);
+int     fs_cat_at      (Dir *dir, const char *path);
+ssize_t fs_pread_at    (Dir *dir, const char *path, void *buf, size_t len, size_t off);
+ssize_t fs_pwrite_at   (Dir *dir, const char *path, const void *buf, size_t len, size_t off);
+int     fs_read_iov_at (Dir *dir, const char *path, size_t off, size_t len,
+                        struct iovec *iov, int iovcnt, size_t *nbytes);
+ssize_t fs_sendfile_at (Dir *dir, int fd, const char *path, size_t off, size_t len);
+int     fs_truncate_at (Dir *dir, const char *path, size_t size);
+int     fs_fallocate_at(Dir *dir, const char *path, size_t off, size_t len);
+int     fs_rm_at       (Dir *dir, const char *path);
+int     fs_cp_at       (Dir *dir, const char *src, const char *dst);
+int     fs_mv_at       (Dir *dir, const char *src, const char *dst);
+int     fs_chmod_at    (Dir *dir, const char *path, uint16_t new_mode);
+int     fs_compress_at (Dir *dir, const char *path, bool on);
+
+/* handles: nome e permissões avaliados uma vez no open; o arquivo
+ * removido com handles abertos só é liberado no último fs_close. Um
+ * handle pode ser usado por qualquer thread (posição sob trava)     */
+int     fs_open   (const char *path, int flags);     /* handle ≥0 ou −1 */
+int     fs_open_at(Dir *dir, const char *path, int flags);
+int     fs_close  (int fd);
+ssize_t fs_read   (int fd, void *buf, size_t len);        /* sequencial */
+ssize_t fs_write  (int fd, const void *buf, size_t len);
+off_t   fs_seek   (int fd, off_t off, int whence);        /* SEEK_*     */
 
 #endif /* FS_H */
@@ -0,0 +1,42 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+/*───────────────────────────────────────────────────────────*/
+/*  Journal – redo log dos metadados da imagem (group commit) */
+/*                                                           */
+/*  As operações marcam as faixas de metadados que alteraram  */
+/*  (jnl_log) entre jnl_begin/jnl_end. Várias transações      */
+/*  formam um lote, gravado e sincronizado de uma vez; só     */
+/*  depois disso o lote é aplicado no arquivo da imagem.      */
+/*───────────────────────────────────────────────────────────*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define JNL_GROUP_TXNS   64            /* transações por lote            */
+#define JNL_GROUP_USEC   20000         /* idade máxima do lote (20 ms)   */
+#define JNL_GROUP_BYTES  (1u << 20)    /* metadados sujos por lote       */
+#define JNL_MAX_BYTES    (8u << 20)    /* checkpoint ao passar disto     */
+#define JNL_LINE         64            /* granularidade das faixas sujas */
+
+/* ─── montagem ───────────────────────────────────────────── */
+/* replay e checkpoint só truncam o diário depois que a imagem recebeu
+ * (e sincronizou) todos os lotes; numa falha ele fica para reaplicar   */
+int   jnl_replay(const char *path, int img_fd);       /* antes de mapear  */
+int   jnl_open  (const char *path, int img_fd,
+                 uint8_t *meta, size_t meta_len);     /* região privada   */
+void  jnl_close (void);                               /* checkpoint final */
+bool  jnl_active(void);
+/* pre: antes de gravar o lote (ex.: msync dos dados – modo "ordered");
+ * post: depois que o lote foi aplicado (ex.: liberações adiadas)       */
+void  jnl_set_commit_hooks(int (*pre)(void), void (*post)(void));
+
+/* ─── transações ─────────────────────────────────────────── */
+void  jnl_begin (void);                               /* aninhável        */
+void  jnl_log   (const void *p, size_t n);            /* faixa alterada   */
+void  jnl_end   (void);                               /* pode gravar lote */
+
+/* ─── durabilidade ───────────────────────────────────────── */
+int   jnl_flush     (void);            /* grava lote + fdatasync + aplica */
+int   jnl_checkpoint(void);            /* flush + fsync imagem + trunca   */
+
+#endif /* JOURNAL_H */
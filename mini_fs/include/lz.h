@@ -0,0 +1,21 @@
+#ifndef LZ_H
+#define LZ_H
+/*───────────────────────────────────────────────────────────*/
+/*  LZ – compressor LZ77 rápido para blocos (formato LZ4-ish) */
+/*                                                           */
+/*  Sequências token | literais | distância (16 bits LE) |    */
+/*  extensão do match; a última só tem literais. O tamanho    */
+/*  descomprimido não é gravado: quem lê já sabe (um bloco).  */
+/*───────────────────────────────────────────────────────────*/
+#include <stddef.h>
+
+#define LZ_MIN_MATCH  4
+#define LZ_HASH_BITS  12               /* tabela de 4096 posições */
+
+/* comprime n bytes em no máximo cap; devolve o tamanho ou 0 se não coube */
+size_t lz_pack  (const void *src, size_t n, void *dst, size_t cap);
+
+/* reconstrói exatamente n bytes lendo no máximo cap; 0 ou −1 (corrompido) */
+int    lz_unpack(const void *src, size_t cap, void *dst, size_t n);
+
+#endif /* LZ_H */
@@ -0,0 +1,24 @@
+#ifndef SERVER_H
+#define SERVER_H
+/*───────────────────────────────────────────────────────────*/
+/*  Server – daemon num socket UNIX (mfs --serve)            */
+/*                                                           */
+/*  Um laço epoll aceita clientes e entrega cada conexão     */
+/*  pronta a um pool de threads. Cada cliente tem a própria  */
+/*  Session; o 1º pedido deve ser  "login <nome> <senha>".   */
+/*                                                           */
+/*  Pedido : uma linha de comando da shell terminada em '\n' */
+/*  Resposta: "<rc> <len>\n" seguido de <len> bytes de saída */
+/*            (rc = SHELL_OK/ERR/EXIT/LOGOUT de shell.h)      */
+/*  Os pedidos podem ser enviados em sequência sem esperar   */
+/*  as respostas, que chegam na mesma ordem.                 */
+/*───────────────────────────────────────────────────────────*/
+
+#define SERVER_BACKLOG   64
+#define SERVER_IN_MAX    (64u << 10)   /* pedidos pendentes por cliente */
+#define SERVER_WRITE_MS  5000          /* cliente que não lê é largado  */
+
+/* roda até SIGINT/SIGTERM; nworkers ≤ 0 = nº de CPUs; 0/−1 */
+int server_run(const char *path, int nworkers);
+
+#endif /* SERVER_H */
@@ -0,0 +1,44 @@
+#ifndef SESSION_H
+#define SESSION_H
+/*───────────────────────────────────────────────────────────*/
+/*  Session – contexto de um usuário: credenciais + cwd      */
+/*                                                           */
+/*  Cada thread opera sobre a sessão ligada a ela            */
+/*  (session_use); sem ligação vale a sessão padrão do       */
+/*  processo, usada pela shell interativa.                   */
+/*───────────────────────────────────────────────────────────*/
+#include <stdio.h>
+#include <stdint.h>
+#include <glib.h>
+#include "directory.h"
+
+typedef struct session {
+    /* ─── credenciais ─────────────────────────────────────── */
+    uint32_t    uid, gid;
+    GArray     *gids;           /* <uint32_t> primário + extras, ordenado */
+    gint        cred_gen;       /* muda a cada login / su / sg / refresh  */
+    gint        db_gen;         /* geração do banco em que gids foi feito */
+
+    /* ─── diretórios ──────────────────────────────────────── */
+    Dir        *cwd;            /* NULL = raiz                            */
+    GHashTable *dcache;         /* cache de caminhos (directory.c)        */
+    gint        xtok;           /* ficha das checagens de X em cache      */
+    gint        xtok_tree, xtok_cred;   /* gerações em que a ficha vale  */
+
+    /* ─── saída ───────────────────────────────────────────── */
+    FILE       *out;            /* mensagens dos comandos; NULL = stdout  */
+} Session;
+
+Session *session_new    (uint32_t uid, uint32_t gid);   /* cwd = raiz   */
+void     session_free   (Session *s);
+Session *session_use    (Session *s);   /* liga à thread; devolve a antiga */
+Session *session_current(void);         /* nunca NULL                      */
+
+/* mensagens e resultados de comandos vão para a saída da sessão
+ * (o daemon de server.c a troca por um buffer a cada pedido)     */
+FILE    *session_out    (void);
+void     session_puts   (const char *s);                 /* com '\n' */
+void     session_printf (const char *fmt, ...)
+         __attribute__((format(printf, 1, 2)));
+
+#endif /* SESSION_H */
@@ -0,0 +1,30 @@
+#ifndef SHELL_H
+#define SHELL_H
+/*───────────────────────────────────────────────────────────*/
+/*  Shell – interpretador dos comandos do mini-fs            */
+/*                                                           */
+/*  Usado pelo REPL de main.c e pelos clientes do daemon     */
+/*  (server.c). Executa na sessão da thread e escreve na     */
+/*  saída dela (session_out).                                */
+/*───────────────────────────────────────────────────────────*/
+
+#include <stdio.h>
+
+#define SHELL_ARGS_MAX  32            /* tokens por linha           */
+
+/* resultado de shell_exec ------------------------------------------- */
+#define SHELL_OK        0
+#define SHELL_ERR      -1             /* comando falhou / uso errado */
+#define SHELL_EXIT      1             /* "exit": encerrar a sessão   */
+#define SHELL_LOGOUT    2             /* "logout": voltou a guest    */
+
+int  shell_exec(char *line);          /* linha sem '\n'; é alterada  */
+/* quebra a linha no lugar: "..." / '...' / \ escapam; > e >> viram
+ * tokens próprios. Devolve argc, ou −1 (aspas abertas / > max)       */
+int  shell_split(char *line, char **argv, int max);
+void shell_help(void);
+/* de onde o console lê a senha admin pedida por joingroup/setperm
+ * (padrão stdin); só pergunta com "Senha admin:" se for um terminal  */
+void shell_set_input(FILE *in);
+
+#endif /* SHELL_H */
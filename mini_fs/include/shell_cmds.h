@@ -0,0 +1,51 @@
+#ifndef SHELL_CMDS_H
+#define SHELL_CMDS_H
+/*───────────────────────────────────────────────────────────*/
+/*  Tabela de comandos da shell (X-macro)                    */
+/*                                                           */
+/*  Lida por shell.c (handlers cmd_<nome>) e por             */
+/*  tools/mkcmdhash.c, que no build procura uma semente sem  */
+/*  colisões para shell_hash e gera shell_hash.h com a       */
+/*  tabela de slots → índice. A ordem aqui é o índice.       */
+/*───────────────────────────────────────────────────────────*/
+#include <stdint.h>
+
+#define SH_ADMIN  0x1                 /* só uid 0 enxerga o comando */
+
+/*  X(nome, mín. args, máx. args, flags, uso) -------------------------- */
+#define SHELL_COMMANDS(X)                                                   \
+    X(exit,      0, 0, 0,        "exit")                                    \
+    X(logout,    0, 0, 0,        "logout")                                  \
+    X(help,      0, 0, 0,        "help")                                    \
+    X(pwd,       0, 0, 0,        "pwd")                                     \
+    X(ls,        0, 1, 0,        "ls [-l]")                                 \
+    X(mkdir,     1, 1, 0,        "mkdir <dir>")                             \
+    X(cd,        1, 1, 0,        "cd <dir>")                                \
+    X(touch,     1, 1, 0,        "touch <arq>")                             \
+    X(echo,      3, 3, 0,        "echo \"txt\" > arq  ou  echo \"txt\" >> arq") \
+    X(cat,       1, 1, 0,        "cat <arq>")                               \
+    X(rm,        1, 1, 0,        "rm <arq>")                                \
+    X(cp,        2, 2, 0,        "cp <orig> <dest>")                        \
+    X(mv,        2, 2, 0,        "mv <orig> <dest>")                        \
+    X(compress,  2, 2, 0,        "compress <arq> on|off")                   \
+    X(joingroup, 1, 2, 0,        "joingroup <grp> [senha-admin]")           \
+    X(sg,        1, 1, 0,        "sg <gid>")                                \
+    X(setperm,   2, 3, 0,        "setperm <owner|group|public> rwx [senha-admin]") \
+    X(stats,     0, 1, 0,        "stats [reset]")                           \
+    X(useradd,   5, 5, SH_ADMIN, "useradd <n> <uid> <gid> <pw> <perm>")     \
+    X(userdel,   1, 1, SH_ADMIN, "userdel <nome>")                          \
+    X(groupadd,  3, 3, SH_ADMIN, "groupadd <n> <gid> <perm>")               \
+    X(su,        1, 1, SH_ADMIN, "su <nome>")                               \
+    X(chmod,     2, 2, SH_ADMIN, "chmod <octal> <arquivo>")                 \
+    X(save,      0, 0, SH_ADMIN, "save")                                    \
+    X(trace,     1, 2, SH_ADMIN, "trace start|stop|dump <arq.json>")
+
+/* FNV-1a com semente; a mesma função no gerador e na shell */
+static inline uint32_t shell_hash(const char *s, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    while (*s) { h ^= (uint8_t)*s++; h *= 16777619u; }
+    return h ^ (h >> 15);
+}
+
+#endif /* SHELL_CMDS_H */
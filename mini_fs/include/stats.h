@@ -0,0 +1,125 @@
+#ifndef STATS_H
+#define STATS_H
+/*───────────────────────────────────────────────────────────*/
+/*  Stats – contadores e histogramas de latência por operação */
+/*                                                           */
+/*  Cada thread soma nos próprios contadores (sem trava nem   */
+/*  RMW atômico); stats_snapshot junta as threads vivas e as  */
+/*  que já saíram. Histogramas em baldes log2 de ns.         */
+/*                                                           */
+/*  Compilado com -DMFS_NO_STATS (make STATS=0) os macros do  */
+/*  caminho quente somem e a API só informa que está          */
+/*  desativada.                                               */
+/*───────────────────────────────────────────────────────────*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define STATS_BUCKETS  32              /* balde i: [2^i, 2^(i+1)) ns    */
+
+/*  X(id, nome, cronometrada) ------------------------------------------ */
+#define STATS_OPS(X)                                                    \
+    X(FS_TOUCH,     "fs_touch",     1)  X(FS_ECHO,      "fs_echo",      1) \
+    X(FS_CAT,       "fs_cat",       1)  X(FS_PREAD,     "fs_pread",     1) \
+    X(FS_PWRITE,    "fs_pwrite",    1)  X(FS_READ_IOV,  "fs_read_iov",  1) \
+    X(FS_SENDFILE,  "fs_sendfile",  1)  X(FS_TRUNCATE,  "fs_truncate",  1) \
+    X(FS_FALLOCATE, "fs_fallocate", 1)  X(FS_RM,        "fs_rm",        1) \
+    X(FS_CP,        "fs_cp",        1)  X(FS_MV,        "fs_mv",        1) \
+    X(FS_CHMOD,     "fs_chmod",     1)  X(FS_OPEN,      "fs_open",      1) \
+    X(FS_CLOSE,     "fs_close",     1)  X(FS_READ,      "fs_read",      1) \
+    X(FS_WRITE,     "fs_write",     1)  X(FS_COMPRESS,  "fs_compress",  1) \
+    X(DIR_MKDIR,    "dir_mkdir",    1)  X(DIR_CD,       "dir_cd",       1) \
+    X(DIR_LS,       "dir_ls",       1)  X(DIR_RESOLVE,  "dir_resolve",  0) \
+    X(BLK_ALLOC,    "block_alloc",  0)  X(BLK_FREE,     "block_free",   0) \
+    X(BLK_ALLOC_RANGE, "block_alloc_range", 0)                             \
+    X(BLK_FREE_RANGE,  "block_free_range",  0)                             \
+    X(BLK_ZPACK,    "block_zpack",  1)  X(BLK_ZREAD,    "block_zread",  0) \
+    X(BLK_ZUNPACK,  "block_zunpack", 1)
+
+typedef enum {
+#define STATS_ENUM(id, name, timed) ST_##id,
+    STATS_OPS(STATS_ENUM)
+#undef STATS_ENUM
+    ST__N
+} stat_op;
+
+typedef struct {
+    uint64_t calls, errors, bytes;
+    uint64_t ns;                       /* tempo total (só cronometradas) */
+    uint64_t hist[STATS_BUCKETS];
+} StatCounter;
+
+/* ─── consulta ───────────────────────────────────────────── */
+bool        stats_enabled  (void);                 /* compilado com stats   */
+const char *stats_name     (stat_op op);
+bool        stats_timed    (stat_op op);
+void        stats_snapshot (StatCounter out[ST__N]);/* soma de todas threads */
+void        stats_reset    (void);
+/* latência (ns) do percentil p ∈ [0,1]: limite superior do balde */
+uint64_t    stats_percentile(const StatCounter *c, double p);
+void        stats_print    (FILE *out);            /* tabela p/ a shell     */
+int         stats_dump_json(const char *path);     /* 0 ou −1               */
+void        stats_dump_at_exit(const char *path);  /* atexit → JSON         */
+
+/* ─── caminho quente ─────────────────────────────────────── */
+#ifdef MFS_NO_STATS
+
+/* rc ainda é avaliado (pode ser a própria chamada); n não */
+#define stats_now()                 ((uint64_t)0)
+#define stats_done(op, t0, rc)      ((void)(t0), (void)(rc))
+#define stats_count(op, rc)         ((void)(rc))
+#define stats_bytes(op, n)          ((void)sizeof(n))
+
+#else
+
+typedef struct { StatCounter c[ST__N]; } StatsTls;
+extern _Thread_local StatsTls *stats_tls;
+StatsTls *stats_tls_init(void);         /* 1ª operação da thread */
+
+/* único escritor por contador: load + store relaxados, sem lock xadd */
+#define STATS_ADD(p, v) __atomic_store_n((p), *(p) + (v), __ATOMIC_RELAXED)
+
+static inline StatCounter *stats_slot(stat_op op)
+{
+    StatsTls *t = stats_tls;
+    if (__builtin_expect(!t, 0)) t = stats_tls_init();
+    return &t->c[op];
+}
+
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* chamada (erro se rc < 0) sem cronômetro */
+static inline void stats_count(stat_op op, long long rc)
+{
+    StatCounter *c = stats_slot(op);
+    STATS_ADD(&c->calls, 1);
+    if (rc < 0) STATS_ADD(&c->errors, 1);
+}
+
+/* chamada cronometrada desde t0 = stats_now() */
+static inline void stats_done(stat_op op, uint64_t t0, long long rc)
+{
+    uint64_t dt = stats_now() - t0;
+    StatCounter *c = stats_slot(op);
+    int b = dt ? 63 - __builtin_clzll(dt) : 0;
+    if (b >= STATS_BUCKETS) b = STATS_BUCKETS - 1;
+    STATS_ADD(&c->calls, 1);
+    STATS_ADD(&c->ns, dt);
+    STATS_ADD(&c->hist[b], 1);
+    if (rc < 0) STATS_ADD(&c->errors, 1);
+}
+
+static inline void stats_bytes(stat_op op, uint64_t n)
+{
+    STATS_ADD(&stats_slot(op)->bytes, n);
+}
+
+#endif /* MFS_NO_STATS */
+
+#endif /* STATS_H */
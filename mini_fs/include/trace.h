@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+/*───────────────────────────────────────────────────────────*/
+/*  Trace – registro de eventos por thread (anel fixo)       */
+/*                                                           */
+/*  Cada chamada instrumentada, com o tracer ligado, grava um */
+/*  TraceRec no anel da própria thread (sem trava). Desligado */
+/*  custa um desvio previsível por ponto de chamada.         */
+/*  trace_dump exporta no formato Chrome trace-event         */
+/*  (chrome://tracing, Perfetto).                            */
+/*───────────────────────────────────────────────────────────*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "stats.h"              /* ids e nomes das operações */
+
+#define TRACE_RING  (1u << 14)         /* registros por thread (pot. de 2) */
+#define TRACE_PERM  ST__N              /* auth_has_perm_mode (fora do stats) */
+
+/* 40 bytes; o significado de key/a/b depende da operação:
+ *   fs_* / dir_resolve  key = hash do caminho (fd em read/write/close)
+ *   block_*             a = 1º bloco, b = quantidade
+ *   block_z(un)pack     a = bloco (de origem / do fragmento), b = capacidade
+ *   auth_has_perm_mode  a = dono, b = grupo                       */
+typedef struct {
+    uint64_t t0, t1;                   /* ns, CLOCK_MONOTONIC */
+    int64_t  rc;                       /* retorno             */
+    uint32_t key;
+    int32_t  a, b;
+    uint16_t op;                       /* stat_op ou TRACE_PERM */
+} TraceRec;
+
+extern bool trace_on;
+
+void     trace_start (void);           /* zera os anéis e liga   */
+void     trace_stop  (void);
+bool     trace_active(void);
+int      trace_dump  (const char *path);   /* JSON; 0 ou −1       */
+void     trace_emit  (unsigned op, uint64_t t0, uint32_t key,
+                      int32_t a, int32_t b, long long rc);
+
+#define TRACE_ON() __builtin_expect(__atomic_load_n(&trace_on, __ATOMIC_RELAXED), 0)
+
+static inline uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* FNV-1a: identifica o caminho no trace sem copiar a string */
+static inline uint32_t trace_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (s && *s) { h ^= (uint8_t)*s++; h *= 16777619u; }
+    return h;
+}
+
+/* rc = call; com o tracer ligado também grava o evento. key, a e b só
+ * são avaliados depois da chamada e só se ligado (podem usar rc)     */
+#define TRACE_CALL(rc, op, key, a, b, call) do {                           \
+        if (TRACE_ON()) {                                                  \
+            uint64_t _tt = trace_now(); (rc) = (call);                     \
+            trace_emit((op), _tt, (key), (a), (b), (long long)(rc));       \
+        } else (rc) = (call);                                              \
+    } while (0)
+
+#endif /* TRACE_H */
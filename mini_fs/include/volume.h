@@ -0,0 +1,85 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+/*───────────────────────────────────────────────────────────*/
+/*  Volume – imagem persistente mapeada em memória (mmap)    */
+/*                                                           */
+/*  [superbloco][bitmap][refcounts][tabela de inodes][dados] */
+/*  O block manager roda direto sobre bitmap/refcounts/dados */
+/*  da imagem; Dir/FCB gravam seus atributos no inode.       */
+/*───────────────────────────────────────────────────────────*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fs.h"
+
+#define VOL_MAGIC       "MINIFS1"      /* 8 bytes com o '\0'          */
+#define VOL_VERSION     1
+#define VOL_NAME_MAX    DIR_NAME_MAX   /* bytes úteis em VolInode.name */
+#define VOL_EXT_INLINE  8              /* extents guardados no inode   */
+#define VOL_INODE_RATIO 4              /* inodes por bloco de dados    */
+#define VOL_NO_BLOCK    UINT32_MAX
+#define VOL_NO_INODE    UINT32_MAX
+#define VOL_ROOT_INO    0
+
+typedef enum { VI_FREE = 0, VI_DIR = 1, VI_FILE = 2 } vikind_t;
+#define VI_F_INLINE  0x1               /* dados em VolInode.data       */
+#define VI_F_ZIP     0x2               /* FCB.zip                      */
+#define VOL_INLINE_MAX (VOL_EXT_INLINE * sizeof(Extent) + 32)
+
+/* superbloco: geometria + estado ---------------------------------------- */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t capacity;                 /* blocos de dados              */
+    uint64_t ninodes;                  /* slots na tabela              */
+    uint64_t bitmap_off, ref_off, itab_off, data_off;
+    uint64_t image_size;
+    uint32_t csum;                     /* FNV-1a dos campos acima      */
+    uint32_t inode_hwm;                /* slots ≥ hwm nunca usados     */
+    uint32_t clean;                    /* 1 = desmontado corretamente  */
+} VolSuper;
+
+/* inode em disco (256 bytes) -------------------------------------------- */
+typedef struct {
+    uint16_t kind;                     /* vikind_t                     */
+    uint16_t perms;
+    uint32_t parent;                   /* inode do diretório pai       */
+    uint32_t owner, group;
+    uint32_t ftype;
+    uint32_t nextents;                 /* total de extents do arquivo  */
+    uint32_t ext_blk;                  /* 1º bloco de extents extras   */
+    uint32_t flags;                    /* VI_F_*                       */
+    uint64_t size;
+    int64_t  created, modified, accessed;
+    char     name[VOL_NAME_MAX + 1];
+    union {
+        struct {
+            Extent   ext[VOL_EXT_INLINE];  /* primeiros extents        */
+            uint32_t tail_blk, tail_off;   /* cauda empacotada (cap ≠ 0) */
+            uint32_t tail_cap;
+            uint8_t  reserved[20];
+        };
+        uint8_t data[VOL_INLINE_MAX];  /* VI_F_INLINE: o próprio arquivo */
+    };
+} VolInode;
+
+/* ─── montagem ───────────────────────────────────────────── */
+int   vol_open  (const char *path,
+                 size_t nblocks, size_t block_sz);  /* monta ou formata; 0/−1 */
+int   vol_sync  (void);                             /* dados + checkpoint     */
+void  vol_close (void);                             /* marca limpo e desmapeia*/
+bool  vol_active(void);
+
+/* ─── tabela de inodes ───────────────────────────────────── */
+uint32_t        vol_ialloc   (void);                /* VOL_NO_INODE se cheia  */
+void            vol_ifree    (uint32_t ino);        /* libera slot + extras   */
+uint32_t        vol_inode_hwm(void);
+const VolInode *vol_inode    (uint32_t ino);
+
+/* ─── write-through de Dir / FCB ─────────────────────────── */
+void  vol_put_dir    (const Dir *d);
+int   vol_put_file   (const FCB *f, uint32_t parent, bool extents);
+int   vol_get_extents(uint32_t ino, GArray *out);
+
+#endif /* VOLUME_H */
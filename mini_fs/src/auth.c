@@ -1,4 +1,6 @@
 #include "auth.h"
+#include "session.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,10 +13,11 @@
 /* ─── tabelas residentes em memória ──────────────────────── */
 static GHashTable *users;      /* <name ,User *> */
 static GHashTable *groups;     /* <name ,Group *> */
+static GHashTable *by_uid;     /* <uid  ,User *>  índice (não é dono) */
+static GHashTable *by_gid;     /* <gid  ,Group *> índice (não é dono) */
+static GRWLock     db_lock;    /* protege as 4 tabelas e as listas de membros */
+static gint        db_gen = 1; /* +1 sob a trava de escrita a cada mudança    */
 
-/* ─── sessão ─────────────────────────────────────────────── */
-static uint32_t cur_uid = 1000;   /* guest */
-static uint32_t cur_gid = 1000;
 static uint32_t next_uid = 2001;
 
 /* ─── protótipos internos que o linker cobrava ───────────── */
@@ -22,13 +25,15 @@ static void     _load_users(void);
 static void     _load_groups(void);
 static gboolean _save_users(void);
 static gboolean _save_groups(void);
+static void     _refresh_session(Session *s);
 
-/* ─── setters / getters ──────────────────────────────────── */
-void auth_set_uid(uint32_t id){ cur_uid = id; }
-void auth_set_gid(uint32_t id){ cur_gid = id; }
-uint32_t auth_uid(void)       { return cur_uid; }
-uint32_t auth_gid(void)       { return cur_gid; }
-bool auth_is_admin(void)      { return cur_uid == 0; }
+/* ─── setters / getters (sessão da thread) ──────────────── */
+/* login / su / sg recalculam o conjunto de grupos da sessão */
+void auth_set_uid(uint32_t id){ Session *s=session_current(); s->uid=id; _refresh_session(s); }
+void auth_set_gid(uint32_t id){ Session *s=session_current(); s->gid=id; _refresh_session(s); }
+uint32_t auth_uid(void)       { return session_current()->uid; }
+uint32_t auth_gid(void)       { return session_current()->gid; }
+bool auth_is_admin(void)      { return session_current()->uid == 0; }
 
 /* ─── liberação ──────────────────────────────────────────── */
 static void _free_user(gpointer p){
@@ -40,35 +45,115 @@ static void _free_group(gpointer p){
     g_free(g);
 }
 
-/* ─── helpers ------------------------------------------------*/
-User *auth_get_user(const char *n){ return g_hash_table_lookup(users,n); }
-Group*auth_get_group(const char *n){return g_hash_table_lookup(groups,n); }
+/* ─── helpers (sem trava: quem chama já segura db_lock) ----- */
+static User *_user(const char *n)        { return g_hash_table_lookup(users,n); }
+static User *_user_by_uid(uint32_t uid)  { return g_hash_table_lookup(by_uid,GUINT_TO_POINTER(uid)); }
+static Group *_group_by_gid(uint32_t gid){ return g_hash_table_lookup(by_gid,GUINT_TO_POINTER(gid)); }
+static bool _gid_exists(uint32_t gid)    { return _group_by_gid(gid)!=NULL; }
 
-User *auth_get_user_by_uid(uint32_t uid){
-    GHashTableIter it; gpointer k,v;
-    g_hash_table_iter_init(&it,users);
-    while(g_hash_table_iter_next(&it,&k,&v))
-        if(((User*)v)->uid==uid) return v;
-    return NULL;
+/* ─── pesquisa ---------------------------------------------- */
+static bool _copy_user(const User *u,User *out){
+    if(u&&out){ *out=*u; out->name=out->passwd=NULL; }
+    return u!=NULL;
+}
+bool auth_get_user(const char *n,User *out){
+    g_rw_lock_reader_lock(&db_lock);
+    bool ok=_copy_user(_user(n),out);
+    g_rw_lock_reader_unlock(&db_lock);
+    return ok;
+}
+bool auth_get_user_by_uid(uint32_t uid,User *out){
+    g_rw_lock_reader_lock(&db_lock);
+    bool ok=_copy_user(_user_by_uid(uid),out);
+    g_rw_lock_reader_unlock(&db_lock);
+    return ok;
+}
+int auth_get_gid_by_name(const char *n,uint32_t *out_gid){
+    g_rw_lock_reader_lock(&db_lock);
+    Group *g=g_hash_table_lookup(groups,n);
+    if(g&&out_gid) *out_gid=g->gid;
+    g_rw_lock_reader_unlock(&db_lock);
+    return g?0:-1;
+}
+bool auth_check_passwd(const char *n,const char *pass){
+    g_rw_lock_reader_lock(&db_lock);
+    User *u=_user(n);
+    bool ok=u&&strcmp(pass,u->passwd)==0;
+    g_rw_lock_reader_unlock(&db_lock);
+    return ok;
 }
 
-static bool _gid_exists(uint32_t gid){
-    GHashTableIter it; gpointer k,v;
-    g_hash_table_iter_init(&it,groups);
-    while(g_hash_table_iter_next(&it,&k,&v))
-        if(((Group*)v)->gid==gid) return true;
+/* ─── grupos da sessão ------------------------------------- */
+static gint _cmp_gid(gconstpointer a,gconstpointer b){
+    uint32_t x=*(const uint32_t*)a,y=*(const uint32_t*)b;
+    return (x>y)-(x<y);
+}
+
+/* primário + todo grupo que lista o usuário da sessão; roda só quando
+ * as credenciais ou o banco mudam (qualquer sessão: db_gen), não a
+ * cada checagem                                                      */
+static void _refresh_session(Session *s)
+{
+    if(!users) return;                     /* antes de auth_init */
+    if(!s->gids) s->gids=g_array_new(FALSE,FALSE,sizeof(uint32_t));
+    g_array_set_size(s->gids,0);
+    g_array_append_val(s->gids,s->gid);
+
+    g_rw_lock_reader_lock(&db_lock);
+    s->db_gen=g_atomic_int_get(&db_gen);
+    User *me=_user_by_uid(s->uid);
+    if(me){
+        GHashTableIter it; gpointer k,v;
+        g_hash_table_iter_init(&it,groups);
+        while(g_hash_table_iter_next(&it,&k,&v)){
+            Group *g=v;
+            if(g->gid!=s->gid &&
+               g_list_find_custom(g->members,me->name,(GCompareFunc)g_strcmp0))
+                g_array_append_val(s->gids,g->gid);
+        }
+    }
+    g_rw_lock_reader_unlock(&db_lock);
+    g_array_sort(s->gids,_cmp_gid);
+    ++s->cred_gen;                         /* checagens de X em cache */
+}
+
+/* groupadd / useradd / joingroup / userdel de outra sessão: os gids
+ * desta são refeitos na próxima checagem                            */
+void auth_session_sync(Session *s)
+{
+    if(s->db_gen!=g_atomic_int_get(&db_gen)) _refresh_session(s);
+}
+
+static bool _in_session(Session *s,uint32_t gid)
+{
+    auth_session_sync(s);
+    if(!s->gids) return gid==s->gid;
+    guint lo=0,hi=s->gids->len;            /* poucos grupos: busca binária */
+    while(lo<hi){
+        guint mid=(lo+hi)/2;
+        uint32_t v=g_array_index(s->gids,uint32_t,mid);
+        if(v==gid) return true;
+        if(v<gid) lo=mid+1; else hi=mid;
+    }
     return false;
 }
 
 /* ─── criação de grupo / usuário ─────────────────────────── */
 int auth_groupadd(const char *n,uint32_t gid,uint16_t perm)
 {
-    if(_gid_exists(gid)||g_hash_table_contains(groups,n)) return -1;
-    Group*g=g_new0(Group,1);
-    g->name=g_strdup(n); g->gid=gid; g->perm=perm&0x1FF;
-    g->members=NULL;
-    g_hash_table_insert(groups,g_strdup(n),g);
-    return 0;
+    int rc=-1;
+    g_rw_lock_writer_lock(&db_lock);
+    if(!_gid_exists(gid)&&!g_hash_table_contains(groups,n)){
+        Group*g=g_new0(Group,1);
+        g->name=g_strdup(n); g->gid=gid; g->perm=perm&0x1FF;
+        g->members=NULL;
+        g_hash_table_insert(groups,g_strdup(n),g);
+        g_hash_table_insert(by_gid,GUINT_TO_POINTER(gid),g);
+        g_atomic_int_inc(&db_gen);
+        rc=0;
+    }
+    g_rw_lock_writer_unlock(&db_lock);
+    return rc;
 }
 
 static void _bump_uid(uint32_t uid){ if(uid>=next_uid) next_uid=uid+1; }
@@ -76,30 +161,71 @@ static void _bump_uid(uint32_t uid){ if(uid>=next_uid) next_uid=uid+1; }
 int auth_useradd(const char *n,uint32_t uid,uint32_t gid,
                  const char *pwd,uint16_t dp)
 {
-    if(g_hash_table_contains(users,n)||!_gid_exists(gid)) return -1;
-    User*u=g_new0(User,1);
-    u->name=g_strdup(n); u->uid=uid; u->gid=gid;
-    u->passwd=g_strdup(pwd); u->dflt_perms=dp&0x1FF;
-    g_hash_table_insert(users,g_strdup(n),u);
-    _bump_uid(uid);
-    return 0;
+    int rc=-1;
+    g_rw_lock_writer_lock(&db_lock);
+    if(!g_hash_table_contains(users,n)&&_gid_exists(gid)&&!_user_by_uid(uid)){
+        User*u=g_new0(User,1);
+        u->name=g_strdup(n); u->uid=uid; u->gid=gid;
+        u->passwd=g_strdup(pwd); u->dflt_perms=dp&0x1FF;
+        g_hash_table_insert(users,g_strdup(n),u);
+        g_hash_table_insert(by_uid,GUINT_TO_POINTER(uid),u);
+        _bump_uid(uid);
+        g_atomic_int_inc(&db_gen);      /* o nome já pode estar num grupo */
+        rc=0;
+    }
+    g_rw_lock_writer_unlock(&db_lock);
+    return rc;
 }
 
 /* ─── alteração de permissões padrão do usuário ──────────── */
 int auth_set_user_perms(const char *n,uint16_t p)
 {
-    User*u=auth_get_user(n); if(!u) return -1;
-    u->dflt_perms=p&0x1FF; return 0;
+    g_rw_lock_writer_lock(&db_lock);
+    User*u=_user(n);
+    if(u) u->dflt_perms=p&0x1FF;
+    g_rw_lock_writer_unlock(&db_lock);
+    return u?0:-1;
+}
+/* troca os 3 bits de uma classe (shift 6/3/0) num passo só: dois setperm
+ * simultâneos do mesmo usuário não perdem um ao outro                  */
+int auth_set_class_perms(uint32_t uid,int sh,uint16_t bits)
+{
+    g_rw_lock_writer_lock(&db_lock);
+    User*u=_user_by_uid(uid);
+    int rc=u?(u->dflt_perms=(u->dflt_perms&~(7<<sh))|((bits&7)<<sh)):-1;
+    g_rw_lock_writer_unlock(&db_lock);
+    return rc;
 }
 
 /* ─── grupos suplementares ----------------------------------*/
+/* com db_lock de escrita; u já conferido */
+static bool _add_member(const User *u,const char *grp,int *rc)
+{
+    Group *g=g_hash_table_lookup(groups,grp);
+    *rc=(!g||!u)?-1:0;
+    bool add=!*rc&&!g_list_find_custom(g->members,u->name,(GCompareFunc)g_strcmp0);
+    if(add){
+        g->members=g_list_append(g->members,g_strdup(u->name));
+        g_atomic_int_inc(&db_gen);
+    }
+    return add;
+}
 int auth_add_user_to_group(const char *user,const char *grp)
 {
-    Group *g=auth_get_group(grp);
-    if(!g||!auth_get_user(user)) return -1;
-    if(g_list_find_custom(g->members,user,(GCompareFunc)g_strcmp0)) return 0;
-    g->members=g_list_append(g->members,g_strdup(user));
-    return 0;
+    int rc;
+    g_rw_lock_writer_lock(&db_lock);
+    _add_member(_user(user),grp,&rc);
+    g_rw_lock_writer_unlock(&db_lock);
+    return rc;
+}
+/* o nome vem do uid sob a mesma trava: nada de User* fora dela */
+int auth_join_group(uint32_t uid,const char *grp)
+{
+    int rc;
+    g_rw_lock_writer_lock(&db_lock);
+    _add_member(_user_by_uid(uid),grp,&rc);
+    g_rw_lock_writer_unlock(&db_lock);
+    return rc;
 }
 
 /* ─── remoção de usuário ------------------------------------*/
@@ -115,34 +241,49 @@ static void _remove_from_all(const char *u){
 int auth_delete_user(const char *n)
 {
     if(strcmp(n,"root")==0) return -1;
-    if(!auth_get_user(n))   return -1;
-    _remove_from_all(n);
-    g_hash_table_remove(users,n);
-    return 0;
+    g_rw_lock_writer_lock(&db_lock);
+    User *u=_user(n);
+    if(u){
+        _remove_from_all(n);
+        g_hash_table_remove(by_uid,GUINT_TO_POINTER(u->uid));
+        g_hash_table_remove(users,n);
+        g_atomic_int_inc(&db_gen);
+    }
+    g_rw_lock_writer_unlock(&db_lock);
+    return u?0:-1;
 }
 
 /* ─── permissões genéricas / arquivo ───────────────────────*/
 bool auth_user_in_group(uint32_t uid,uint32_t gid)
 {
-    Group *g=NULL; GHashTableIter it;gpointer k,v;
-    g_hash_table_iter_init(&it,groups);
-    while(g_hash_table_iter_next(&it,&k,&v)){
-        g=v; if(g->gid==gid) break; else g=NULL;
-    }
-    if(!g) return false;
-    return g_list_find_custom(g->members,
-                              auth_get_user_by_uid(uid)->name,
-                              (GCompareFunc)g_strcmp0)!=NULL;
+    Session *s=session_current();
+    if(uid==s->uid) return _in_session(s,gid);
+    g_rw_lock_reader_lock(&db_lock);
+    Group *g=_group_by_gid(gid);
+    User  *u=_user_by_uid(uid);
+    bool in=g&&u&&g_list_find_custom(g->members,u->name,
+                                     (GCompareFunc)g_strcmp0)!=NULL;
+    g_rw_lock_reader_unlock(&db_lock);
+    return in;
+}
+/* caminho quente: sem varreduras nem travas – só a sessão da thread
+ * (e uma leitura atômica de db_gen)                                  */
+static bool _perm_mode(uint32_t owner,uint32_t group,
+                       uint16_t perms,uint16_t bit)
+{
+    Session *s=session_current();
+    if(s->uid==0) return true;                /* root */
+    uint16_t cls = (s->uid==owner)        ? (perms>>6)&7 :
+                   _in_session(s,group)   ? (perms>>3)&7 : perms&7;
+    return (cls & bit)!=0;
 }
 bool auth_has_perm_mode(uint32_t owner,uint32_t group,
                         uint16_t perms,uint16_t bit)
 {
-    if(auth_uid()==0) return true;            /* root */
-    uint16_t cls = (auth_uid()==owner) ? (perms>>6)&7 :
-                   (auth_gid()==group||
-                    auth_user_in_group(auth_uid(),group))
-                                 ? (perms>>3)&7 : perms&7;
-    return (cls & bit)!=0;
+    bool ok;
+    TRACE_CALL(ok,TRACE_PERM,0,(int32_t)owner,(int32_t)group,
+               _perm_mode(owner,group,perms,bit));
+    return ok;
 }
 bool auth_has_perm(const FCB *f,uint16_t bit)
 { return auth_has_perm_mode(f->owner,f->group,f->perms,bit); }
@@ -182,7 +323,18 @@ static gboolean _save_groups(void)
     g_string_free(out,TRUE);
     return ok;
 }
-int auth_save(void){ return _save_users()&&_save_groups()?0:-1; }
+/* várias sessões (daemon) podem salvar ao mesmo tempo: uma gravação
+ * por vez, com as tabelas travadas para leitura                      */
+int auth_save(void)
+{
+    static GMutex save_lock;
+    g_mutex_lock(&save_lock);
+    g_rw_lock_reader_lock(&db_lock);
+    int rc=_save_users()&&_save_groups()?0:-1;
+    g_rw_lock_reader_unlock(&db_lock);
+    g_mutex_unlock(&save_lock);
+    return rc;
+}
 
 /* ---- _load helpers --------------------------------------- */
 static void _load_users(void)
@@ -208,11 +360,14 @@ static void _load_groups(void)
         char n[64],mb[512]="";uint32_t gid;uint16_t perm;
         sscanf(*l,"%63s %u %hu %[^\n]",n,&gid,&perm,mb);
         if(auth_groupadd(n,gid,perm)!=0) continue;
-        Group*g=auth_get_group(n);
         if(*mb){
             gchar **m=g_strsplit(mb,",",-1);
+            g_rw_lock_writer_lock(&db_lock);
+            Group*g=g_hash_table_lookup(groups,n);
             for(gchar **x=m;*x;++x) if(**x)
                 g->members=g_list_append(g->members,g_strdup(*x));
+            g_atomic_int_inc(&db_gen);
+            g_rw_lock_writer_unlock(&db_lock);
             g_strfreev(m);
         }
     }
@@ -225,7 +380,7 @@ static bool _create_account(void)
     char n[32],p[32];
     printf("Novo usuário ‒ nome: "); fgets(n,sizeof n,stdin);
     n[strcspn(n,"\n")]='\0';
-    if(!*n||auth_get_user(n)){ puts("Nome inválido/existente"); return false;}
+    if(!*n||auth_get_user(n,NULL)){ puts("Nome inválido/existente"); return false;}
 
     printf("Senha: "); fgets(p,sizeof p,stdin);
     p[strcspn(p,"\n")]='\0';
@@ -243,6 +398,8 @@ void auth_init(void)
 {
     users  = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,_free_user);
     groups = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,_free_group);
+    by_uid = g_hash_table_new(g_direct_hash,g_direct_equal);
+    by_gid = g_hash_table_new(g_direct_hash,g_direct_equal);
 
     auth_groupadd("root",  0,0);
     auth_groupadd("guest",1000,0);
@@ -251,6 +408,7 @@ void auth_init(void)
 
     _load_users();
     _load_groups();
+    _refresh_session(session_current());
 }
 
 bool auth_login(void)
@@ -264,18 +422,29 @@ bool auth_login(void)
 
         char n[32],p[32];
         printf("Usuário: "); fgets(n,32,stdin); n[strcspn(n,"\n")]='\0';
-        User*u=auth_get_user(n); if(!u){ puts("Inexistente"); continue; }
+        if(!auth_get_user(n,NULL)){ puts("Inexistente"); continue; }
 
         printf("Senha: "); fgets(p,32,stdin); p[strcspn(p,"\n")]='\0';
-        if(strcmp(p,u->passwd)!=0){ puts("Senha incorreta"); continue; }
+        if(!auth_authenticate(n,p)){ puts("Senha incorreta"); continue; }
 
-        auth_set_uid(u->uid); auth_set_gid(u->gid);
-        printf("Bem-vindo, %s!\n",u->name);
+        printf("Bem-vindo, %s!\n",n);
         return true;
     }
 }
+
+/* confere nome/senha e, se baterem, assume a identidade na sessão atual */
+bool auth_authenticate(const char *name,const char *pass)
+{
+    g_rw_lock_reader_lock(&db_lock);
+    User *u=_user(name);
+    bool ok=u&&strcmp(pass,u->passwd)==0;
+    uint32_t uid=ok?u->uid:0,gid=ok?u->gid:0;
+    g_rw_lock_reader_unlock(&db_lock);
+    if(ok){ auth_set_uid(uid); auth_set_gid(gid); }
+    return ok;
+}
 void auth_logout(void)
 {
     auth_set_uid(1000); auth_set_gid(1000);
-    puts("logout → guest");
+    session_puts("logout → guest");
 }
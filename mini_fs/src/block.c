@@ -1,85 +1,1186 @@
+#define _GNU_SOURCE     /* MAP_ANONYMOUS, MAP_NORESERVE, MADV_HUGEPAGE */
 #include "block.h"
+#include "journal.h"
+#include "lz.h"
+#include "stats.h"
+#include "trace.h"
+#include <glib.h>       /* GMutex, GPrivate */
 #include <string.h>     /* memset, memcpy */
+#include <stdlib.h>     /* calloc, free   */
+#include <sys/mman.h>   /* mmap, mprotect, madvise */
+#include <unistd.h>     /* sysconf        */
 #include <assert.h>
 
-/*  Área de dados: bloco físico × bytes  ---------------------------------- */
-static uint8_t _data[BLOCK_COUNT][BLOCK_SIZE];
+#define HUGEPAGE_SIZE  (2u << 20)        /* THP em x86-64: 2 MiB          */
+#define BLOCK_SCAN_TRIES 64              /* palavras disputadas por fatia */
 
-/*  Bitmap: 1 bit por bloco  ---------------------------------------------- */
-static uint8_t _bitmap[(BLOCK_COUNT + 7) / 8];
+/*  Área de dados: região reservada (PROT_NONE) e liberada em fatias ---- *
+ *  _data[0 .. _ncommit·_bsize) é leitura/escrita; o resto só existe      *
+ *  como espaço de endereçamento até o volume crescer.                    */
+static uint8_t *_data;
+static void    *_map_base;              /* p/ munmap (antes do alinhamento) */
+static size_t   _map_len;
+
+static size_t   _bsize;                 /* bytes por bloco                 */
+static size_t   _capacity;              /* limite de blocos                */
+static size_t   _ncommit;               /* blocos já acessíveis            */
+static size_t   _chunk;                 /* blocos por expansão             */
+static bool     _attached;              /* área/bitmap/refs vêm do volume  */
+
+/*  Bitmap hierárquico (1 = ocupado)  ------------------------------------- *
+ *  nível 0: 1 bit por bloco, em palavras de 64 bits                        *
+ *  nível 1: 1 bit por palavra do nível 0 (1 = palavra cheia)               *
+ *  _l1e   : 1 bit por palavra do nível 0 (1 = palavra toda livre), usado   *
+ *           por block_alloc_range p/ achar faixas longas sem varrer L0     *
+ *  Blocos ainda não liberados pelo crescimento ficam marcados ocupados.    *
+ *  Todas as palavras mudam só por operações atômicas: reservar é um CAS    *
+ *  em L0; os sumários são dicas, corrigidas por quem muda a palavra.       */
+#define WORD_BITS  64
+#define WORDS(n)   (((n) + WORD_BITS - 1) / WORD_BITS)
+#define LD(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+
+static uint64_t *_l0;
+static uint64_t *_l1;
+static uint64_t *_l1e;
+static size_t    _l0_words, _l1_words;
+
+/*  Contagem de referências por bloco (cp copy-on-write) ----------------- *
+ *  0 = livre; block_free só devolve o bloco ao bitmap ao chegar a zero.   */
+static uint32_t *_ref;
+
+/*  Liberações adiadas (volume com journal) ------------------------------ *
+ *  Um bloco cuja última referência caiu só volta ao bitmap depois que o   *
+ *  lote do journal que registrou a queda ficou durável: até lá ele ainda  *
+ *  pode ser referenciado pela versão em disco e não pode ser reescrito.   *
+ *  Bit ocupado + refcount 0 = liberação pendente (refeita na montagem).   */
+static uint32_t *_pending;
+static size_t    _npending, _pending_cap;
+static GMutex    _pend_lock;
+
+/*  Fragmentos ----------------------------------------------------------- *
+ *  Um contêiner de fragmentos é uma faixa de nblk blocos dividida em      *
+ *  BLOCK_FRAG_SLOTS fatias; cada fragmento é uma faixa de fatias e conta  *
+ *  1 referência em cada bloco do contêiner. Há dois conjuntos: caudas     *
+ *  (1 bloco, faixas alinhadas de 2^k fatias, que crescem no lugar) e      *
+ *  blocos comprimidos (BLOCK_ZRUN blocos, nº exato de fatias). As         *
+ *  máscaras só existem na memória: a montagem as refaz a partir dos       *
+ *  inodes (block_frag_claim, block_zclaim). Com o journal, fatias soltas  *
+ *  só voltam a valer no commit, como os blocos.                           */
+typedef struct {
+    GPtrArray *list;            /* contêineres com alguma fatia livre     */
+    guint      hint;            /* onde a próxima busca começa            */
+    unsigned   nblk;            /* blocos por contêiner                   */
+} FragPool;
+
+typedef struct {
+    uint32_t  blk;              /* 1º bloco do contêiner                  */
+    FragPool *pool;
+    guint     at;               /* posição em pool->list ou G_MAXUINT     */
+    uint64_t  used;             /* fatias ocupadas, inclusive pendentes   */
+    uint64_t  pend;             /* soltas, esperando o commit             */
+} FragBlock;
+
+#define FRAG_KEY(b) GUINT_TO_POINTER((guint)(b) + 1)
+
+static GHashTable *_frag_idx;   /* 1º bloco → FragBlock*                  */
+static FragPool    _ftail = { .nblk = 1 };
+static FragPool    _fzip  = { .nblk = BLOCK_ZRUN };
+static GPtrArray  *_frag_pend;  /* FragBlock* com pend ≠ 0                */
+static GMutex      _frag_lock;  /* tudo acima; antes de _pend_lock        */
+
+/*  Cache de blocos comprimidos ------------------------------------------ *
+ *  BLOCK_ZCACHE blocos já descomprimidos, em BLOCK_ZSHARDS fatias por id, *
+ *  cada uma com sua trava; numa fatia sai o usado há mais tempo. A chave  *
+ *  é o id: block_zfree tira a entrada antes de o fragmento poder ser      *
+ *  reaproveitado, então um id no cache sempre tem o conteúdo atual. A     *
+ *  falta descomprime fora da trava, no buffer da thread, e só entra no    *
+ *  cache se nenhum block_zfree passou pela fatia nesse meio-tempo (gen).  */
+#define ZC_WAYS (BLOCK_ZCACHE / BLOCK_ZSHARDS)
+_Static_assert(BLOCK_ZCACHE % BLOCK_ZSHARDS == 0, "fatias do cache iguais");
+
+typedef struct {
+    uint32_t id;                /* 0 = vazia                              */
+    uint64_t tick;              /* último uso                             */
+    uint8_t *buf;               /* _bsize bytes                           */
+} ZEntry;
+
+typedef struct {
+    GMutex   lock;
+    uint64_t tick, gen;         /* gen: +1 a cada block_zfree na fatia    */
+    ZEntry   e[ZC_WAYS];
+} ZShard;
+
+static ZShard   _zc[BLOCK_ZSHARDS];
+static _Thread_local uint8_t *_ztmp;     /* falta: descompressão da thread */
+static _Thread_local size_t   _ztmp_len;
+static GPrivate  _ztmp_key = G_PRIVATE_INIT(g_free);
+
+/*  Fatias (shards) do bitmap -------------------------------------------- *
+ *  Cada fatia é um intervalo de palavras do nível 1 com sua própria dica  *
+ *  next-fit; cada thread começa a busca na sua fatia, então threads       *
+ *  diferentes raramente disputam as mesmas palavras.                      */
+typedef struct {
+    size_t lo, hi;              /* palavras L1 [lo, hi)                   */
+    size_t hint;                /* palavra L0 onde começa a próxima busca */
+} Shard;
+
+static Shard    _shard[BLOCK_SHARDS];
+static size_t   _nshards;
+static size_t   _nfree;         /* livres no bitmap (fora das magazines)  */
+static size_t   _nmag;          /* blocos nas magazines (época atual)     */
+static GMutex   _grow_lock;     /* mprotect + _ncommit                    */
+
+/*  Magazines por thread ------------------------------------------------- *
+ *  Pilha de blocos já reservados no bitmap (bit 1, refcount 0): alocar e  *
+ *  liberar 1 bloco não toca estado compartilhado; a magazine é reposta e  *
+ *  esvaziada em lotes de BLOCK_MAG_BATCH (um CAS por palavra).           *
+ *  A trava (busy) é do dono, que a pega sem disputa com um xchg; outra   *
+ *  thread só a pega para devolver a magazine ao bitmap quando o volume   *
+ *  fica sem espaço (_reclaim) e, se preciso, espera girando.             *
+ *  Numa queda, esses blocos voltam como liberações pendentes.            */
+typedef struct {
+    int      busy;              /* trava; ordem: _mags_lock → busy        */
+    uint32_t blk[BLOCK_MAG_SIZE];
+    int      n;                 /* guardados (total de todas em _nmag)    */
+    unsigned epoch;             /* geometria em que os blocos valem       */
+    unsigned home;              /* fatia preferida                        */
+} Magazine;
+
+static GPtrArray *_mags;        /* todas as magazines vivas               */
+static GMutex     _mags_lock;
+static unsigned   _epoch = 1;   /* muda a cada block_init/attach          */
+static gint       _next_home;
+
+static _Thread_local Magazine *_mag;
+static void _mag_exit(gpointer p);
+static GPrivate   _mag_key = G_PRIVATE_INIT(_mag_exit);
+
+static inline void _mag_lock(Magazine *m)
+{
+    while (__atomic_exchange_n(&m->busy, 1, __ATOMIC_ACQUIRE)) g_thread_yield();
+}
+static inline void _mag_unlock(Magazine *m) { __atomic_store_n(&m->busy, 0, __ATOMIC_RELEASE); }
 
 /*  Helpers para operar na bitmap  ---------------------------------------- */
-static inline void _set_bit(int idx)   { _bitmap[idx >> 3] |=  (1U << (idx & 7)); }
-static inline void _clr_bit(int idx)   { _bitmap[idx >> 3] &= ~(1U << (idx & 7)); }
-static inline int  _tst_bit(int idx)   { return _bitmap[idx >> 3] &   (1U << (idx & 7)); }
+static inline uint64_t _bit(size_t i)  { return 1ULL << (i % WORD_BITS); }
+
+/* bitmap e refcounts do volume são metadados: avisa o journal */
+static inline void _dirty(const void *p, size_t n) { if (_attached) jnl_log(p, n); }
+
+static inline void _set_ref(size_t idx, uint32_t v)
+{
+    __atomic_store_n(&_ref[idx], v, __ATOMIC_RELAXED);
+    _dirty(&_ref[idx], sizeof *_ref);
+}
+
+/* sumários depois de uma mudança em L0: quem pôs a dica confere a palavra
+ * de novo e desfaz se outra thread a mudou no meio                      */
+static void _after_set(size_t w, uint64_t now)
+{
+    _dirty(&_l0[w], sizeof *_l0);
+    __atomic_and_fetch(&_l1e[w / WORD_BITS], ~_bit(w), __ATOMIC_SEQ_CST);
+    if (now != ~0ULL) return;
+    __atomic_or_fetch(&_l1[w / WORD_BITS], _bit(w), __ATOMIC_SEQ_CST);     /* cheia */
+    if (LD(&_l0[w]) != ~0ULL)
+        __atomic_and_fetch(&_l1[w / WORD_BITS], ~_bit(w), __ATOMIC_SEQ_CST);
+}
+static void _after_clr(size_t w, uint64_t now)
+{
+    _dirty(&_l0[w], sizeof *_l0);
+    __atomic_and_fetch(&_l1[w / WORD_BITS], ~_bit(w), __ATOMIC_SEQ_CST);  /* há espaço */
+    if (now) return;
+    __atomic_or_fetch(&_l1e[w / WORD_BITS], _bit(w), __ATOMIC_SEQ_CST);   /* toda livre */
+    if (LD(&_l0[w]))
+        __atomic_and_fetch(&_l1e[w / WORD_BITS], ~_bit(w), __ATOMIC_SEQ_CST);
+}
+
+/* devolve ao bitmap os bits `mask` da palavra `w` (todos reservados) */
+static void _clr_mask(size_t w, uint64_t mask)
+{
+    _after_clr(w, __atomic_and_fetch(&_l0[w], ~mask, __ATOMIC_SEQ_CST));
+    __atomic_add_fetch(&_nfree, (size_t)__builtin_popcountll(mask), __ATOMIC_RELAXED);
+}
+static inline void _clr_bit(size_t idx) { _clr_mask(idx / WORD_BITS, _bit(idx)); }
+
+static inline int  _tst_bit(size_t idx)
+{
+    return (LD(&_l0[idx / WORD_BITS]) & _bit(idx)) != 0;
+}
+
+static inline size_t _committed(void) { return __atomic_load_n(&_ncommit, __ATOMIC_ACQUIRE); }
+
+/*  índice válido e já acessível? ---------------------------------------- */
+static inline bool _valid(int index)
+{
+    return index >= 0 && (size_t)index < _committed();
+}
+
+/*  faixa [index, index+n) acessível e alocada (confere as pontas) ------- */
+static inline bool _valid_run(int index, size_t n)
+{
+    return n && _valid(index) && (size_t)index + n <= _committed() &&
+           _tst_bit((size_t)index) && _tst_bit((size_t)index + n - 1);
+}
+
+/*  Busca next-fit numa fatia: percorre o nível 1 a partir da dica, dando  *
+ *  a volta uma única vez; a palavra inicial é visitada em duas metades.   *
+ *  empty: palavra toda livre (L1e); senão, palavra com algum bit livre.   *
+ *  Retorna a palavra L0 (−1 se nenhuma) – ainda não reservada.            */
+static long _scan(Shard *sh, bool empty)
+{
+    size_t span = sh->hi - sh->lo;
+    size_t h    = __atomic_load_n(&sh->hint, __ATOMIC_RELAXED);
+    size_t s0   = h / WORD_BITS, b0 = h % WORD_BITS;
+    if (s0 < sh->lo || s0 >= sh->hi) { s0 = sh->lo; b0 = 0; }
+
+    for (size_t i = 0; i <= span; ++i) {
+        size_t   s     = sh->lo + (s0 - sh->lo + i) % span;
+        uint64_t avail = empty ? LD(&_l1e[s]) : ~LD(&_l1[s]);
+        if (i == 0)    avail &= ~0ULL << b0;
+        if (i == span) avail &= _bit(b0) - 1;
+        if (avail) return (long)(s * WORD_BITS + (size_t)__builtin_ctzll(avail));
+    }
+    return -1;
+}
+
+/*  Palavra disputada (dica do sumário ainda velha): a próxima busca da -- *
+ *  fatia começa depois dela                                               */
+static inline void _skip(Shard *sh, size_t w)
+{
+    __atomic_store_n(&sh->hint, w + 1, __ATOMIC_RELAXED);
+}
+
+/*  Reserva até `max` bits livres (quaisquer) da palavra `w` com um CAS --- */
+static uint64_t _claim_any(size_t w, unsigned max)
+{
+    uint64_t old = LD(&_l0[w]), got;
+    do {
+        uint64_t fr = ~old;
+        got = 0;
+        for (unsigned k = 0; k < max && fr; ++k) { got |= fr & -fr; fr &= fr - 1; }
+        if (!got) return 0;
+    } while (!__atomic_compare_exchange_n(&_l0[w], &old, old | got, false,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    _after_set(w, old | got);
+    return got;
+}
+
+/*  Reserva a faixa contígua livre que começa em `p` (até `want` blocos);  *
+ *  um CAS por palavra. Retorna quantos vieram – 0 se `p` já foi tomado.   */
+static size_t _claim_run(size_t p, size_t want)
+{
+    size_t n = 0, lim = _committed();
+    while (n < want && p + n < lim) {
+        size_t   q = p + n, w = q / WORD_BITS, b = q % WORD_BITS, k;
+        uint64_t old = LD(&_l0[w]), mask;
+        do {
+            uint64_t used = old >> b;
+            k = used ? (size_t)__builtin_ctzll(used) : WORD_BITS - b;
+            k = MIN(k, MIN(want - n, lim - q));
+            if (!k) return n;
+            mask = (k == WORD_BITS ? ~0ULL : (1ULL << k) - 1) << b;
+        } while (!__atomic_compare_exchange_n(&_l0[w], &old, old | mask, false,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+        _after_set(w, old | mask);
+        n += k;
+        if (b + k < WORD_BITS) break;        /* acabou dentro da palavra */
+    }
+    return n;
+}
+
+/*  Expande a área acessível em uma fatia (até _capacity) ---------------- *
+ *  `seen`: _ncommit visto por quem não achou espaço; se outra thread já   *
+ *  cresceu nesse meio-tempo, só manda tentar de novo.                      */
+static int _grow(size_t seen)
+{
+    g_mutex_lock(&_grow_lock);
+    int rc = 0;
+    if (_ncommit != seen) goto out;
+    if (_ncommit >= _capacity) { rc = -1; goto out; }
+
+    size_t n = _capacity - _ncommit;
+    if (n > _chunk) n = _chunk;
+
+    if (mprotect(_data + _ncommit * _bsize, n * _bsize,
+                 PROT_READ | PROT_WRITE) != 0) { rc = -1; goto out; }
+
+    for (size_t i = _ncommit; i < _ncommit + n; ) {       /* por palavra */
+        size_t   b = i % WORD_BITS, k = MIN(WORD_BITS - b, _ncommit + n - i);
+        uint64_t m = (k == WORD_BITS ? ~0ULL : (1ULL << k) - 1) << b;
+        _clr_mask(i / WORD_BITS, m);
+        i += k;
+    }
+    for (size_t k = 0; k < _nshards; ++k)      /* buscas recomeçam no novo */
+        if (_ncommit / WORD_BITS / WORD_BITS < _shard[k].hi)
+            __atomic_store_n(&_shard[k].hint, _ncommit / WORD_BITS, __ATOMIC_RELAXED);
+    __atomic_store_n(&_ncommit, _ncommit + n, __ATOMIC_RELEASE);
+out:
+    g_mutex_unlock(&_grow_lock);
+    return rc;
+}
+
+/*  Divide o nível 1 em fatias iguais (ao menos 1 palavra L1 cada) -------- */
+static void _shards_init(void)
+{
+    _nshards = MIN((size_t)BLOCK_SHARDS, _l1_words);
+    for (size_t k = 0; k < _nshards; ++k) {
+        _shard[k].lo   = k * _l1_words / _nshards;
+        _shard[k].hi   = (k + 1) * _l1_words / _nshards;
+        _shard[k].hint = _shard[k].lo * WORD_BITS;
+    }
+}
+
+static void _frag_reset(void)
+{
+    if (_frag_idx) {
+        GHashTableIter it; gpointer k, v;
+        g_hash_table_iter_init(&it, _frag_idx);
+        while (g_hash_table_iter_next(&it, &k, &v)) g_free(v);
+        g_hash_table_destroy(_frag_idx);
+        g_ptr_array_free(_ftail.list, TRUE);
+        g_ptr_array_free(_fzip.list, TRUE);
+        g_ptr_array_free(_frag_pend, TRUE);
+    }
+    _frag_idx   = g_hash_table_new(g_direct_hash, g_direct_equal);
+    _ftail.list = g_ptr_array_new();
+    _fzip.list  = g_ptr_array_new();
+    _frag_pend  = g_ptr_array_new();
+    _ftail.hint = _fzip.hint = 0;
+}
+
+static void _zc_reset(void)
+{
+    for (int k = 0; k < BLOCK_ZSHARDS; ++k) {
+        ZShard *z = &_zc[k];
+        g_mutex_lock(&z->lock);
+        for (int i = 0; i < ZC_WAYS; ++i) g_free(z->e[i].buf);
+        memset(z->e, 0, sizeof z->e);
+        z->tick = 0;
+        ++z->gen;
+        g_mutex_unlock(&z->lock);
+    }
+}
+
+static void _release(void)
+{
+    if (!_attached) {
+        if (_map_base) munmap(_map_base, _map_len);
+        free(_l0); free(_ref);
+    }
+    free(_l1); free(_l1e); free(_pending);
+    _map_base = NULL; _data = NULL; _l0 = _l1 = _l1e = NULL; _ref = NULL;
+    _pending = NULL; _npending = _pending_cap = 0;
+    _capacity = _ncommit = _nfree = _nmag = _nshards = 0;
+    _attached = false;
+    _frag_reset();
+    _zc_reset();
+    ++_epoch;                               /* magazines antigas não valem */
+}
+
+static bool _valid_geometry(size_t capacity, size_t block_size)
+{
+    /* tamanho de bloco: potência de 2 ≥ 512 (fatias alinhadas a página) */
+    if (!capacity || block_size < 512 || (block_size & (block_size - 1)))
+        return false;
+    return capacity <= (size_t)INT32_MAX && capacity <= SIZE_MAX / block_size;
+}
 
 /* ------------------------------------------------------------------------ */
-void block_init(void)
+int block_init(size_t capacity, size_t block_size, unsigned flags)
 {
-    memset(_bitmap, 0, sizeof(_bitmap));     /* tudo livre                 */
-    /* opcional: limpar dados para zero ‒ não é estritamente necessário */
+    _release();
+    if (!_valid_geometry(capacity, block_size)) return -1;
+
+    size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+    size_t align = (flags & BLOCK_F_HUGEPAGE) ? HUGEPAGE_SIZE : page;
+    size_t bytes = capacity * block_size;
+
+    _chunk = BLOCK_GROW_CHUNK;
+    while (_chunk * block_size < align) _chunk *= 2;   /* fatia ≥ alinhamento */
+
+    /* reserva sem comprometer memória; sobra p/ alinhar em 2 MiB -------- */
+    _map_len  = bytes + align;
+    _map_base = mmap(NULL, _map_len, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (_map_base == MAP_FAILED) { _map_base = NULL; return -1; }
+
+    uintptr_t p = ((uintptr_t)_map_base + align - 1) & ~(uintptr_t)(align - 1);
+    _data = (uint8_t *)p;
+#ifdef MADV_HUGEPAGE
+    if (flags & BLOCK_F_HUGEPAGE) madvise(_data, bytes, MADV_HUGEPAGE);
+#endif
+
+    _bsize     = block_size;
+    _capacity  = capacity;
+    _l0_words  = WORDS(capacity);
+    _l1_words  = WORDS(_l0_words);
+    _l0 = calloc(_l0_words, sizeof *_l0);
+    _l1 = calloc(_l1_words, sizeof *_l1);
+    _l1e = calloc(_l1_words, sizeof *_l1e);
+    _ref = calloc(capacity, sizeof *_ref);
+    if (!_l0 || !_l1 || !_l1e || !_ref) { _release(); return -1; }
+
+    /* nada acessível ainda: tudo "ocupado" até _grow liberar ----------- */
+    memset(_l0, 0xff, _l0_words * sizeof *_l0);
+    memset(_l1, 0xff, _l1_words * sizeof *_l1);
+    _ncommit = _nfree = 0;
+    _shards_init();
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+int block_attach(void *data, uint64_t *bitmap, uint32_t *refs,
+                 size_t capacity, size_t block_size, bool recover)
+{
+    _release();
+    if (!_valid_geometry(capacity, block_size)) return -1;
+
+    _attached  = true;
+    _data      = data;
+    _l0        = bitmap;
+    _ref       = refs;
+    _bsize     = block_size;
+    _capacity  = _ncommit = capacity;
+    _l0_words  = WORDS(capacity);
+    _l1_words  = WORDS(_l0_words);
+    _l1  = calloc(_l1_words, sizeof *_l1);
+    _l1e = calloc(_l1_words, sizeof *_l1e);
+    if (!_l1 || !_l1e) { _release(); return -1; }
+
+    /* liberações pendentes de uma sessão interrompida ----------------- */
+    if (recover)
+        for (size_t i = 0; i < capacity; ++i)
+            if (!_ref[i] && (_l0[i / WORD_BITS] & _bit(i))) {
+                _l0[i / WORD_BITS] &= ~_bit(i);
+                _dirty(&_l0[i / WORD_BITS], sizeof *_l0);
+            }
+
+    /* garante bits além da capacidade ocupados e refaz os sumários ---- */
+    if (capacity % WORD_BITS) _l0[capacity / WORD_BITS] |= ~0ULL << (capacity % WORD_BITS);
+    for (size_t w = _l0_words; w < _l1_words * WORD_BITS; ++w)
+        _l1[w / WORD_BITS] |= _bit(w);
+    _nfree = 0;
+    for (size_t w = 0; w < _l0_words; ++w) {
+        if (_l0[w] == ~0ULL) _l1 [w / WORD_BITS] |= _bit(w);
+        if (_l0[w] == 0)     _l1e[w / WORD_BITS] |= _bit(w);
+        _nfree += WORD_BITS - (size_t)__builtin_popcountll(_l0[w]);
+    }
+    _shards_init();
+    return 0;
 }
 
 /* ------------------------------------------------------------------------ */
+/*  magazine da thread (criada no 1º uso; esvaziada quando a thread sai) */
+static Magazine *_magazine(void)
+{
+    Magazine *m = _mag;
+    if (m && m->epoch == _epoch) return m;
+    if (!m) {
+        m = g_new0(Magazine, 1);
+        m->home = (unsigned)g_atomic_int_add(&_next_home, 1);
+        g_mutex_lock(&_mags_lock);
+        if (!_mags) _mags = g_ptr_array_new();
+        g_ptr_array_add(_mags, m);
+        g_mutex_unlock(&_mags_lock);
+        g_private_set(&_mag_key, m);
+        _mag = m;
+    }
+    _mag_lock(m);
+    __atomic_store_n(&m->n, 0, __ATOMIC_RELAXED);    /* geometria nova */
+    m->epoch = _epoch;
+    _mag_unlock(m);
+    return m;
+}
+
+static gint _cmp_u32(gconstpointer a, gconstpointer b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*  Devolve ao bitmap os `k` blocos do topo da magazine, agrupados por ---- *
+ *  palavra (um and atômico por palavra)                                    */
+static void _drain(Magazine *m, int k)
+{
+    uint32_t *b = m->blk + m->n - k;
+    qsort(b, (size_t)k, sizeof *b, _cmp_u32);
+    for (int i = 0; i < k; ) {
+        size_t   w    = b[i] / WORD_BITS;
+        uint64_t mask = 0;
+        for (; i < k && b[i] / WORD_BITS == w; ++i) mask |= _bit(b[i]);
+        _clr_mask(w, mask);
+    }
+    __atomic_store_n(&m->n, m->n - k, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&_nmag, (size_t)k, __ATOMIC_RELAXED);
+}
+
+/* sai da lista antes de esvaziar: _reclaim segura _mags_lock a varredura
+ * inteira, então depois disso ninguém mais enxerga a magazine          */
+static void _mag_exit(gpointer p)
+{
+    Magazine *m = p;
+    g_mutex_lock(&_mags_lock);
+    g_ptr_array_remove_fast(_mags, m);
+    g_mutex_unlock(&_mags_lock);
+    if (m->epoch == _epoch && m->n) _drain(m, m->n);
+    g_free(m);
+}
+
+/* devolve ao bitmap os blocos de todas as magazines (inclusive de outras
+ * threads, com a trava de cada uma); retorna quantos voltaram. Chamado
+ * sem segurar a trava de nenhuma magazine                              */
+static size_t _reclaim(void)
+{
+    size_t n = 0;
+    g_mutex_lock(&_mags_lock);
+    for (guint i = 0; _mags && i < _mags->len; ++i) {
+        Magazine *m = g_ptr_array_index(_mags, i);
+        _mag_lock(m);
+        if (m->epoch == _epoch && m->n) { n += (size_t)m->n; _drain(m, m->n); }
+        _mag_unlock(m);
+    }
+    g_mutex_unlock(&_mags_lock);
+    return n;
+}
+
+/*  Repõe a magazine com um lote reservado de uma vez (fatia da thread ---- *
+ *  primeiro, depois as vizinhas); cresce a área se tudo estiver cheio.    */
+static int _refill(Magazine *m)
+{
+    for (;;) {
+        size_t seen = _committed();
+        for (size_t k = 0; k < _nshards; ++k) {
+            Shard *sh = &_shard[(m->home + k) % _nshards];
+            for (int tries = 0; tries < BLOCK_SCAN_TRIES; ++tries) {
+                long w = _scan(sh, false);
+                if (w < 0) break;
+                uint64_t got = _claim_any((size_t)w, BLOCK_MAG_BATCH);
+                if (!got) { _skip(sh, (size_t)w); continue; }  /* outra levou */
+                __atomic_store_n(&sh->hint, (size_t)w, __ATOMIC_RELAXED);
+                __atomic_sub_fetch(&_nfree, (size_t)__builtin_popcountll(got), __ATOMIC_RELAXED);
+                int n = m->n;
+                for (; got; got &= got - 1)            /* topo = menor bloco */
+                    m->blk[n++] = (uint32_t)((size_t)w * WORD_BITS + (size_t)__builtin_ctzll(got));
+                for (int a = m->n, z = n - 1; a < z; ++a, --z) {
+                    uint32_t t = m->blk[a]; m->blk[a] = m->blk[z]; m->blk[z] = t;
+                }
+                __atomic_add_fetch(&_nmag, (size_t)(n - m->n), __ATOMIC_RELAXED);
+                __atomic_store_n(&m->n, n, __ATOMIC_RELAXED);
+                return n;
+            }
+        }
+        if (_grow(seen)) return 0;                     /* sem espaço */
+    }
+}
+
+/* bitmap vazio: os blocos parados nas magazines de outras threads
+ * voltam e a busca se repete uma vez                               */
+static int _alloc_one(void)
+{
+    for (int pass = 0; ; ++pass) {
+        Magazine *m = _magazine();
+        int       i = -1;
+        _mag_lock(m);
+        if (m->n || _refill(m)) {
+            __atomic_store_n(&m->n, m->n - 1, __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&_nmag, 1, __ATOMIC_RELAXED);
+            i = (int)m->blk[m->n];
+        }
+        _mag_unlock(m);
+        if (i >= 0) { _set_ref((size_t)i, 1); return i; }
+        if (pass || !_reclaim()) return -1;
+    }
+}
+
 int block_alloc(void)
 {
-    for (int i = 0; i < BLOCK_COUNT; ++i) {
-        if (!_tst_bit(i)) {           /* livre? */
-            _set_bit(i);
-            memset(_data[i], 0, BLOCK_SIZE); /* zera conteúdo */
-            return i;
+    int i;
+    TRACE_CALL(i, ST_BLK_ALLOC, 0, i, 1, _alloc_one());
+    stats_count(ST_BLK_ALLOC, i);
+    return i;
+}
+
+/* ------------------------------------------------------------------------ */
+/*  Faixa direto no bitmap: pedidos grandes começam numa palavra toda      *
+ *  livre; sem nenhuma, cresce a área antes de aceitar qualquer bit livre. *
+ *  Blocos em magazines não entram em faixas: sem nada no bitmap, elas são *
+ *  devolvidas (_reclaim) e a busca recomeça uma vez.                      */
+static size_t _alloc_range(size_t want, size_t *start)
+{
+    Magazine *m       = _magazine();
+    bool      big     = want >= WORD_BITS, flushed = false;
+    for (;;) {
+        size_t seen = _committed();
+        for (size_t k = 0; k < _nshards; ++k) {
+            Shard *sh = &_shard[(m->home + k) % _nshards];
+            for (int tries = 0; tries < BLOCK_SCAN_TRIES; ++tries) {
+                long w = _scan(sh, big);
+                if (w < 0) break;
+                uint64_t fr = ~LD(&_l0[w]);
+                size_t   p  = (size_t)w * WORD_BITS + (fr ? (size_t)__builtin_ctzll(fr) : 0);
+                size_t   n  = fr ? _claim_run(p, want) : 0;
+                if (!n) { _skip(sh, (size_t)w); continue; }
+
+                /* no fim da área acessível tenta crescer e emendar ----- */
+                while (n < want && p + n == _committed() && _grow(p + n) == 0)
+                    n += _claim_run(p + n, want - n);
+                __atomic_store_n(&sh->hint, (p + n - 1) / WORD_BITS, __ATOMIC_RELAXED);
+                __atomic_sub_fetch(&_nfree, n, __ATOMIC_RELAXED);
+                *start = p;
+                return n;
+            }
         }
+        if (big && seen >= _capacity) { big = false; continue; }
+        if (_grow(seen)) {
+            if (big) { big = false; continue; }
+            if (flushed || !_reclaim()) return 0;
+            flushed = true;
+        }
+    }
+}
+
+static int _alloc_run(size_t want, size_t *got)
+{
+    if (want <= 1) {                              /* caminho da magazine */
+        int i = _alloc_one();
+        if (i >= 0) { *got = 1; stats_bytes(ST_BLK_ALLOC_RANGE, _bsize); }
+        stats_count(ST_BLK_ALLOC_RANGE, i);
+        return i;
+    }
+    size_t start, n = _alloc_range(want, &start);
+    stats_count(ST_BLK_ALLOC_RANGE, n ? 0 : -1);
+    if (!n) return -1;
+    stats_bytes(ST_BLK_ALLOC_RANGE, n * _bsize);
+    for (size_t i = start; i < start + n; ++i) __atomic_store_n(&_ref[i], 1, __ATOMIC_RELAXED);
+    _dirty(&_ref[start], n * sizeof *_ref);
+    *got = n;
+    return (int)start;
+}
+
+int block_alloc_range(size_t want, size_t *got)
+{
+    int i;
+    TRACE_CALL(i, ST_BLK_ALLOC_RANGE, 0, i, i < 0 ? 0 : (int32_t)*got, _alloc_run(want, got));
+    return i;
+}
+
+/*  Faixa de exatamente n ≤ WORD_BITS blocos (contêineres de fragmentos):  *
+ *  varre o bitmap inteiro atrás de n bits livres seguidos numa palavra.   *
+ *  Se uma disputa deixa a faixa curta, os bits voltam direto ao bitmap:   *
+ *  nunca tiveram refcount nem chegaram ao journal como liberação.         *
+ *  Sem nada, cresce a área e depois esvazia as magazines, como as faixas. */
+static long _alloc_exact(size_t n)
+{
+    bool flushed = false;
+    for (;;) {
+        size_t seen = _committed();
+        for (size_t s = 0; s < _l1_words; ++s)
+            for (uint64_t avail = ~LD(&_l1[s]); avail; avail &= avail - 1) {
+                size_t w = s * WORD_BITS + (size_t)__builtin_ctzll(avail);
+                if (w >= _l0_words) break;
+                uint64_t fr = ~LD(&_l0[w]), fit = fr;
+                for (size_t k = 1; k < n; ++k) fit &= fr >> k;   /* início de n livres */
+                if (!fit) continue;
+                size_t p = w * WORD_BITS + (size_t)__builtin_ctzll(fit), got = _claim_run(p, n);
+                __atomic_sub_fetch(&_nfree, got, __ATOMIC_RELAXED);
+                if (got == n) return (long)p;
+                if (got) _clr_mask(w, ((1ULL << got) - 1) << (p % WORD_BITS));
+            }
+        if (!_grow(seen)) continue;
+        if (flushed || !_reclaim()) return -1;
+        flushed = true;
     }
-    return -1;                        /* sem espaço */
 }
 
 /* ------------------------------------------------------------------------ */
+static void _release_block(size_t index)
+{
+    Magazine *m = _magazine();
+    _mag_lock(m);
+    if (m->n == BLOCK_MAG_SIZE) _drain(m, BLOCK_MAG_BATCH);
+    m->blk[m->n] = (uint32_t)index;
+    __atomic_store_n(&m->n, m->n + 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_nmag, 1, __ATOMIC_RELAXED);
+    _mag_unlock(m);
+}
+
+static int _free_one(int index)
+{
+    if (!_valid(index) || !_tst_bit((size_t)index)) return -1;
+    uint32_t r = __atomic_load_n(&_ref[index], __ATOMIC_RELAXED);
+    do { if (!r) return -1; }                 /* já livre               */
+    while (!__atomic_compare_exchange_n(&_ref[index], &r, r - 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    _dirty(&_ref[index], sizeof *_ref);
+    if (r > 1) return 0;                      /* ainda compartilhado    */
+
+    if (_attached && jnl_active()) {          /* espera o commit        */
+        g_mutex_lock(&_pend_lock);
+        if (_npending == _pending_cap) {
+            size_t cap = _pending_cap ? _pending_cap * 2 : 256;
+            uint32_t *p = realloc(_pending, cap * sizeof *p);
+            if (p) { _pending = p; _pending_cap = cap; }
+        }
+        bool queued = _npending < _pending_cap;
+        if (queued) _pending[_npending++] = (uint32_t)index;
+        g_mutex_unlock(&_pend_lock);
+        if (queued) return 0;
+    }
+    _release_block((size_t)index);
+    return 0;
+}
+
 void block_free(int index)
 {
-    if (index < 0 || index >= BLOCK_COUNT) return;
-    _clr_bit(index);
-    /* opcional: zerar dados para evitar “lixo” residual           */
-    memset(_data[index], 0, BLOCK_SIZE);
+    int rc;
+    TRACE_CALL(rc, ST_BLK_FREE, 0, index, 1, _free_one(index));
+    stats_count(ST_BLK_FREE, rc);
+}
+
+static void _frag_commit(void);
+
+/* vai direto ao bitmap: roda no commit, não na thread que liberou.
+ * As fatias vêm antes: um bloco de fragmentos que esvaziou sai do
+ * índice antes de poder voltar ao bitmap                           */
+void block_release_pending(void)
+{
+    _frag_commit();
+    g_mutex_lock(&_pend_lock);
+    for (size_t i = 0; i < _npending; ++i)
+        if (!__atomic_load_n(&_ref[_pending[i]], __ATOMIC_RELAXED))
+            _clr_bit(_pending[i]);
+    _npending = 0;
+    g_mutex_unlock(&_pend_lock);
+}
+
+/* esvazia as magazines de todas as threads (cada uma com a sua trava) */
+void block_flush_caches(void) { _reclaim(); }
+
+/* ------------------------------------------------------------------------ */
+static int _free_run(int start, size_t n)
+{
+    int rc = 0;
+    for (size_t i = 0; i < n; ++i) rc |= _free_one(start + (int)i);
+    return rc;
+}
+
+void block_free_range(int start, size_t n)
+{
+    int rc;
+    TRACE_CALL(rc, ST_BLK_FREE_RANGE, 0, start, (int32_t)n, _free_run(start, n));
+    stats_count(ST_BLK_FREE_RANGE, rc);
+    stats_bytes(ST_BLK_FREE_RANGE, n * _bsize);
+}
+
+/* ------------------------------------------------------------------------ */
+int block_ref_range(int start, size_t n)
+{
+    if (!_valid_run(start, n)) return -1;
+    for (size_t i = (size_t)start; i < (size_t)start + n; ++i)
+        __atomic_add_fetch(&_ref[i], 1, __ATOMIC_RELAXED);
+    _dirty(&_ref[start], n * sizeof *_ref);
+    return 0;
+}
+
+uint32_t block_refcount(int index)
+{
+    return _valid(index) ? __atomic_load_n(&_ref[index], __ATOMIC_ACQUIRE) : 0;
 }
 
 /* ------------------------------------------------------------------------ */
-size_t block_write(int index,
-                   const void *buf,
-                   size_t len,
-                   size_t offset)
+/* livres no bitmap + guardados nas magazines (faixas os alcançam via
+ * _reclaim) + área ainda não acessível; O(1), sem trava               */
+size_t block_free_count(void)
 {
-    if (index < 0 || index >= BLOCK_COUNT || !_tst_bit(index))
+    return __atomic_load_n(&_nfree, __ATOMIC_RELAXED) +
+           __atomic_load_n(&_nmag, __ATOMIC_RELAXED) + (_capacity - _committed());
+}
+
+size_t block_size(void)     { return _bsize;    }
+size_t block_capacity(void) { return _capacity; }
+
+/* ------------------------------------------------------------------------ */
+size_t block_write_run(int start,
+                       size_t nblk,
+                       const void *buf,
+                       size_t len,
+                       size_t offset)
+{
+    if (!_valid_run(start, nblk))
         return 0;                                   /* bloco inválido ou livre */
 
-    if (offset >= BLOCK_SIZE) return 0;
+    size_t span = nblk * _bsize;
+    if (offset >= span) return 0;
 
-    size_t max = BLOCK_SIZE - offset;
+    size_t max = span - offset;
     if (len > max) len = max;
 
-    memcpy(_data[index] + offset, buf, len);
+    memcpy(_data + (size_t)start * _bsize + offset, buf, len);
     return len;
 }
 
+size_t block_write(int index, const void *buf, size_t len, size_t offset)
+{
+    return block_write_run(index, 1, buf, len, offset);
+}
+
 /* ------------------------------------------------------------------------ */
-size_t block_read(int index,
-                  void *buf,
-                  size_t len,
-                  size_t offset)
+size_t block_read_run(int start,
+                      size_t nblk,
+                      void *buf,
+                      size_t len,
+                      size_t offset)
 {
-    if (index < 0 || index >= BLOCK_COUNT || !_tst_bit(index))
+    if (!_valid_run(start, nblk))
         return 0;
 
-    if (offset >= BLOCK_SIZE) return 0;
+    size_t span = nblk * _bsize;
+    if (offset >= span) return 0;
 
-    size_t max = BLOCK_SIZE - offset;
+    size_t max = span - offset;
     if (len > max) len = max;
 
-    memcpy(buf, _data[index] + offset, len);
+    memcpy(buf, _data + (size_t)start * _bsize + offset, len);
     return len;
 }
 
+size_t block_read(int index, void *buf, size_t len, size_t offset)
+{
+    return block_read_run(index, 1, buf, len, offset);
+}
+
+/* ------------------------------------------------------------------------ */
+/* acesso direto (sem cópia) aos bytes de uma faixa contígua               */
+const void *block_data(int start, size_t nblk)
+{
+    return _valid_run(start, nblk) ? _data + (size_t)start * _bsize : NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+int block_copy(int dst, int src, size_t nblk)
+{
+    if (!_valid_run(dst, nblk) || !_valid_run(src, nblk)) return -1;
+    memcpy(_data + (size_t)dst * _bsize,
+           _data + (size_t)src * _bsize, nblk * _bsize);
+    return 0;
+}
+
 /* ------------------------------------------------------------------------ */
 bool block_is_free(int index)
 {
-    return (index < 0 || index >= BLOCK_COUNT) ? true : !_tst_bit(index);
+    return _valid(index) ? !_tst_bit((size_t)index) : true;
+}
+
+/* ------------------------------------------------------------------------ */
+/*  Fragmentos                                                              */
+static inline size_t   _fslot(const FragPool *pl)     { return pl->nblk * _bsize / BLOCK_FRAG_SLOTS; }
+static inline uint64_t _fmask(unsigned p, unsigned k) { return (k >= WORD_BITS ? ~0ULL : (1ULL << k) - 1) << p; }
+
+/* mantém a lista do conjunto só com contêineres que têm fatia livre e
+ * solta o vazio                                                      */
+static void _frag_update(FragBlock *b)
+{
+    GPtrArray *l = b->pool->list;
+    bool listed = b->at != G_MAXUINT, keep = b->used && b->used != ~0ULL;
+    if (listed && !keep) {
+        FragBlock *last = g_ptr_array_index(l, l->len - 1);
+        last->at = b->at;
+        g_ptr_array_remove_index_fast(l, b->at);
+        b->at = G_MAXUINT;
+    } else if (!listed && keep) {
+        b->at = l->len;
+        g_ptr_array_add(l, b);
+    }
+    if (!b->used) { g_hash_table_remove(_frag_idx, FRAG_KEY(b->blk)); g_free(b); }
+}
+
+static FragBlock *_frag_new(FragPool *pl, uint32_t blk)
+{
+    FragBlock *b = g_new0(FragBlock, 1);
+    b->blk  = blk;
+    b->pool = pl;
+    b->at   = G_MAXUINT;
+    g_hash_table_insert(_frag_idx, FRAG_KEY(blk), b);
+    return b;
+}
+
+/* 1ª faixa de k fatias livres em `used` (alinhada a k se `align`), ou −1 */
+static int _frag_fit(uint64_t used, unsigned k, bool align)
+{
+    for (unsigned p = 0; p + k <= BLOCK_FRAG_SLOTS; p += align ? k : 1)
+        if (!(used & _fmask(p, k))) return (int)p;
+    return -1;
+}
+
+/* contêiner novo: faixa de exatamente nblk blocos (refcount 1 em cada) */
+static int _frag_blocks(unsigned nblk)
+{
+    if (nblk == 1) return block_alloc();
+    long b = _alloc_exact(nblk);
+    stats_count(ST_BLK_ALLOC_RANGE, b < 0 ? -1 : 0);
+    if (b < 0) return -1;
+    stats_bytes(ST_BLK_ALLOC_RANGE, nblk * _bsize);
+    for (size_t i = (size_t)b; i < (size_t)b + nblk; ++i) __atomic_store_n(&_ref[i], 1, __ATOMIC_RELAXED);
+    _dirty(&_ref[b], nblk * sizeof *_ref);
+    return (int)b;
+}
+
+/* k fatias num contêiner do conjunto; devolve o 1º bloco dele (1ª fatia
+ * em *at) ou −1                                                         */
+static int _frag_take(FragPool *pl, unsigned k, bool align, unsigned *at)
+{
+    g_mutex_lock(&_frag_lock);
+    FragBlock *b = NULL;
+    int p = -1;
+    for (guint i = 0, n = MIN(pl->list->len, BLOCK_FRAG_SCAN); i < n && p < 0; ++i) {
+        b = g_ptr_array_index(pl->list, (pl->hint + i) % pl->list->len);
+        p = _frag_fit(b->used, k, align);
+    }
+    if (p >= 0) {
+        block_ref_range((int)b->blk, pl->nblk);   /* +1 fragmento vivo */
+    } else {
+        int nb = _frag_blocks(pl->nblk);
+        if (nb < 0) { g_mutex_unlock(&_frag_lock); return -1; }
+        b = _frag_new(pl, (uint32_t)nb);
+        p = 0;
+    }
+    b->used |= _fmask((unsigned)p, k);
+    _frag_update(b);
+    if (b->at != G_MAXUINT) pl->hint = b->at;
+    int blk = (int)b->blk;
+    g_mutex_unlock(&_frag_lock);
+    *at = (unsigned)p;
+    return blk;
+}
+
+static void _frag_clear(FragBlock *b, uint64_t m)
+{
+    b->used &= ~m;
+    _frag_update(b);
+}
+
+static void _frag_drop(int blk, unsigned p, unsigned k)
+{
+    uint64_t m = _fmask(p, k);
+    g_mutex_lock(&_frag_lock);
+    FragBlock *b = g_hash_table_lookup(_frag_idx, FRAG_KEY(blk));
+    if (b && (b->used & m) == m && !(b->pend & m)) {
+        unsigned nblk = b->pool->nblk;
+        if (_attached && jnl_active()) {          /* espera o commit */
+            if (!b->pend) g_ptr_array_add(_frag_pend, b);
+            b->pend |= m;
+        } else {
+            _frag_clear(b, m);
+        }
+        block_free_range(blk, nblk);              /* −1 fragmento vivo */
+    }
+    g_mutex_unlock(&_frag_lock);
+}
+
+static void _frag_commit(void)
+{
+    g_mutex_lock(&_frag_lock);
+    for (guint i = 0; i < _frag_pend->len; ++i) {
+        FragBlock *b = g_ptr_array_index(_frag_pend, i);
+        uint64_t   m = b->pend;
+        b->pend = 0;
+        _frag_clear(b, m);
+    }
+    g_ptr_array_set_size(_frag_pend, 0);
+    g_mutex_unlock(&_frag_lock);
+}
+
+static int _frag_claim(FragPool *pl, int blk, unsigned p, unsigned k)
+{
+    if (!k || p + k > BLOCK_FRAG_SLOTS || !_valid_run(blk, pl->nblk)) return -1;
+    uint64_t m = _fmask(p, k);
+    g_mutex_lock(&_frag_lock);
+    FragBlock *b = g_hash_table_lookup(_frag_idx, FRAG_KEY(blk));
+    if (!b) b = _frag_new(pl, (uint32_t)blk);
+    int rc = b->pool != pl || (b->used & m) ? -1 : 0;  /* imagem ruim */
+    if (!rc) { b->used |= m; _frag_update(b); }
+    g_mutex_unlock(&_frag_lock);
+    return rc;
+}
+
+/*  caudas: bytes ↔ fatias de 1 bloco */
+int block_frag_alloc(size_t len, uint32_t *off, uint32_t *cap)
+{
+    size_t   slot = _fslot(&_ftail);
+    unsigned k    = 1, p;
+    if (!len || len > _bsize / 2) return -1;
+    while (k * slot < len) k <<= 1;
+
+    int blk = _frag_take(&_ftail, k, true, &p);
+    if (blk < 0) return -1;
+    *off = (uint32_t)(p * slot);
+    *cap = (uint32_t)(k * slot);
+    return blk;
+}
+
+void block_frag_free(int blk, uint32_t off, uint32_t cap)
+{
+    size_t slot = _fslot(&_ftail);
+    _frag_drop(blk, (unsigned)(off / slot), (unsigned)(cap / slot));
+}
+
+int block_frag_claim(int blk, uint32_t off, uint32_t cap)
+{
+    size_t slot = _fslot(&_ftail);
+    if (!cap || cap > _bsize / 2 || cap % slot || (cap & (cap - 1)) || off % cap)
+        return -1;
+    return _frag_claim(&_ftail, blk, (unsigned)(off / slot), (unsigned)(cap / slot));
+}
+
+/* ------------------------------------------------------------------------ */
+/*  Blocos comprimidos                                                      *
+ *  Fragmento de nº exato de fatias num contêiner de BLOCK_ZRUN blocos:     *
+ *  com tamanhos parecidos (~1/3 de bloco) um bloco só levaria dois.        *
+ *  id = BLOCK_Z | (fatias − 1) << 27 | 1ª fatia << 21 | 1º bloco           */
+#define Z_MAX(bs)  ((bs) / 4 * 3)           /* compensa até 3/4 do bloco */
+_Static_assert(BLOCK_FRAG_SLOTS == 64, "a fatia ocupa 6 bits do id");
+_Static_assert(BLOCK_Z_BLKS == 1u << 21, "o bloco ocupa 21 bits do id");
+_Static_assert(BLOCK_FRAG_SLOTS / BLOCK_ZRUN * 3 / 4 <= 16, "nº de fatias cabe em 4 bits");
+
+static inline size_t   _z_slot(void)        { return _fslot(&_fzip); }
+static inline int      _z_blk (uint32_t id) { return (int)(id & (BLOCK_Z_BLKS - 1)); }
+static inline unsigned _z_p   (uint32_t id) { return id >> 21 & 63; }
+static inline unsigned _z_k   (uint32_t id) { return (id >> 27 & 15) + 1; }
+static inline size_t   _z_cap (uint32_t id) { return _z_k(id) * _z_slot(); }
+static inline const uint8_t *_z_ptr(uint32_t id)
+{ return _data + (size_t)_z_blk(id) * _bsize + _z_p(id) * _z_slot(); }
+
+static inline bool _z_valid(uint32_t id)
+{
+    return (id & BLOCK_Z) && _z_p(id) + _z_k(id) <= BLOCK_FRAG_SLOTS &&
+           _valid_run(_z_blk(id), BLOCK_ZRUN);
+}
+
+/* n ≤ Z_MAX bytes num fragmento novo; id ou 0 */
+static uint32_t _z_store(const void *z, size_t n)
+{
+    unsigned k = (unsigned)((n + _z_slot() - 1) / _z_slot()), p;
+    int blk = _frag_take(&_fzip, k, false, &p);
+    if (blk < 0) return 0;
+    if ((uint32_t)blk >= BLOCK_Z_BLKS) { _frag_drop(blk, p, k); return 0; }
+    block_write_run(blk, BLOCK_ZRUN, z, n, p * _z_slot());
+    return BLOCK_Z | (k - 1) << 27 | p << 21 | (uint32_t)blk;
+}
+
+static uint32_t _zpack(int index)
+{
+    if (!_valid_run(index, 1)) return 0;
+    size_t   max = Z_MAX(_bsize);
+    uint8_t *z   = g_malloc(max);
+    size_t   n   = lz_pack(_data + (size_t)index * _bsize, _bsize, z, max);
+    uint32_t id  = n ? _z_store(z, n) : 0;
+    g_free(z);
+    return id;
+}
+
+uint32_t block_zpack(int index)
+{
+    uint64_t t0 = stats_now();
+    uint32_t id;
+    TRACE_CALL(id, ST_BLK_ZPACK, 0, index, id ? (int32_t)_z_cap(id) : 0, _zpack(index));
+    stats_done(ST_BLK_ZPACK, t0, 0);
+    if (id) stats_bytes(ST_BLK_ZPACK, _z_cap(id));
+    return id;
+}
+
+static int _zunpack(uint32_t id, uint8_t *out)
+{
+    return _z_valid(id) ? lz_unpack(_z_ptr(id), _z_cap(id), out, _bsize) : -1;
+}
+
+/* fatia do cache: bits altos do hash, para ids do mesmo contêiner
+ * (que só diferem na fatia inicial) também se espalharem          */
+static inline ZShard *_zshard(uint32_t id)
+{
+    return &_zc[((id * 2654435761u) >> 24) % BLOCK_ZSHARDS];
+}
+
+/* entrada com id na fatia ou NULL; com z->lock */
+static ZEntry *_zc_find(ZShard *z, uint32_t id)
+{
+    for (int i = 0; i < ZC_WAYS; ++i)
+        if (z->e[i].id == id) return &z->e[i];
+    return NULL;
+}
+
+/* bloco descomprimido entra no lugar do mais antigo; com z->lock */
+static void _zc_put(ZShard *z, uint32_t id, const uint8_t *blk)
+{
+    ZEntry *v = &z->e[0];
+    for (int i = 1; i < ZC_WAYS; ++i)
+        if (z->e[i].tick < v->tick) v = &z->e[i];
+    if (!v->buf) v->buf = g_malloc(_bsize);
+    memcpy(v->buf, blk, _bsize);
+    v->id   = id;
+    v->tick = ++z->tick;
+}
+
+/* buffer de um bloco da thread (faltas do cache) */
+static uint8_t *_zc_tmp(void)
+{
+    if (_ztmp_len != _bsize) {
+        g_private_replace(&_ztmp_key, _ztmp = g_malloc(_bsize));
+        _ztmp_len = _bsize;
+    }
+    return _ztmp;
+}
+
+size_t block_zread(uint32_t id, void *buf, size_t len, size_t offset)
+{
+    if (offset >= _bsize) return 0;
+    if (len > _bsize - offset) len = _bsize - offset;
+    ZShard *z = _zshard(id);
+    g_mutex_lock(&z->lock);
+    ZEntry  *e   = _zc_find(z, id);
+    uint64_t gen = z->gen;
+    if (e) {
+        e->tick = ++z->tick;
+        memcpy(buf, e->buf + offset, len);
+    }
+    g_mutex_unlock(&z->lock);
+
+    int rc = 0;
+    if (!e) {                                /* falta: fora da trava */
+        uint8_t *tmp = _zc_tmp();
+        uint64_t t0  = stats_now();
+        TRACE_CALL(rc, ST_BLK_ZUNPACK, 0, _z_blk(id), (int32_t)_z_cap(id), _zunpack(id, tmp));
+        stats_done(ST_BLK_ZUNPACK, t0, rc);
+        if (!rc) {
+            memcpy(buf, tmp + offset, len);
+            g_mutex_lock(&z->lock);
+            if (z->gen == gen && !_zc_find(z, id)) _zc_put(z, id, tmp);
+            g_mutex_unlock(&z->lock);
+        }
+    }
+    stats_count(ST_BLK_ZREAD, rc);
+    return rc ? 0 : len;
+}
+
+void block_zfree(uint32_t id)
+{
+    if (!_z_valid(id)) return;
+    ZShard *z = _zshard(id);
+    g_mutex_lock(&z->lock);
+    ZEntry *e = _zc_find(z, id);
+    if (e) e->id = 0, e->tick = 0;
+    ++z->gen;
+    g_mutex_unlock(&z->lock);
+    _frag_drop(_z_blk(id), _z_p(id), _z_k(id));
+}
+
+/* fragmentos não se compartilham: a cópia leva os bytes comprimidos */
+uint32_t block_zdup(uint32_t id)
+{
+    return _z_valid(id) ? _z_store(_z_ptr(id), _z_cap(id)) : 0;
+}
+
+int block_zclaim(uint32_t id)
+{
+    if (!(id & BLOCK_Z)) return -1;
+    return _frag_claim(&_fzip, _z_blk(id), _z_p(id), _z_k(id));
 }
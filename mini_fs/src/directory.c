@@ -1,14 +1,65 @@
 
- #include "directory.h"
+#include "directory.h"
 #include "auth.h"       /* para UID/GID e permissões */
 #include "fs.h"         /* para _destroy_fcb e blocos */
+#include "volume.h"     /* inodes persistentes         */
+#include "journal.h"    /* transação do mkdir          */
+#include "session.h"    /* cwd, cache e credenciais    */
+#include "stats.h"      /* contadores por operação     */
+#include "trace.h"      /* eventos do _resolve         */
 #include <glib.h>
 #include <stdio.h>
 #include <string.h>
 
+#define DCACHE_MAX  4096          /* entradas antes de esvaziar o cache */
+
 /*──────────────── globais ─────────────*/
+/* diretórios nunca são removidos: um Dir* vale até o fim do processo;
+ * o cwd fica na sessão de cada thread                                */
 static Dir *root = NULL;
-static Dir *cwd  = NULL;
+
+/*──────────────── cache de caminhos ───*/
+/* por sessão: (dir de partida, caminho) → Dir*; entradas de fichas
+ * antigas são ignoradas e sobrescritas. Só resoluções bem-sucedidas
+ * entram.                                                             */
+typedef struct {
+    Dir        *start;
+    const char *path;               /* aponta para o fim do próprio nó */
+} DKey;
+
+typedef struct {
+    Dir *dir;
+    gint tok;
+} DEnt;
+
+static gint dgen = 1;               /* geração da árvore / permissões  */
+static gint tok_next = 1;           /* 0 = "nunca verificado" em x_tok */
+
+static guint _dk_hash(gconstpointer k)
+{
+    const DKey *a=k;
+    return g_str_hash(a->path) ^ g_direct_hash(a->start);
+}
+static gboolean _dk_equal(gconstpointer x,gconstpointer y)
+{
+    const DKey *a=x,*b=y;
+    return a->start==b->start && strcmp(a->path,b->path)==0;
+}
+
+void dir_invalidate(void){ g_atomic_int_inc(&dgen); }
+
+/* ficha da sessão: única entre sessões e renovada quando a árvore ou as
+ * credenciais (inclusive os grupos, via banco) mudam – vale tanto para
+ * Dir.x_tok quanto para o cache                                        */
+static gint _token(Session *s)
+{
+    auth_session_sync(s);               /* pode mudar cred_gen */
+    gint g=g_atomic_int_get(&dgen);
+    if(s->xtok && s->xtok_tree==g && s->xtok_cred==s->cred_gen) return s->xtok;
+    s->xtok=g_atomic_int_add(&tok_next,1);
+    s->xtok_tree=g; s->xtok_cred=s->cred_gen;
+    return s->xtok;
+}
 
 /* comparação alfabética para GTree */
 static gint _cmp(gconstpointer a,gconstpointer b,gpointer u){ (void)u;
@@ -23,13 +74,10 @@ bool dir_has_perm(const Dir *d,uint16_t bit)
 }
 
 /*──────────────── destrutor de arquivos dentro da pasta ─────────────*/
+/* entrada removida da pasta; fs.c adia a liberação se o arquivo está aberto */
 static void _destroy_fcb(gpointer data)
 {
-    FCB *f = data; if(!f) return;
-    for(guint i=0;i<f->blocks->len;++i)
-        block_free(GPOINTER_TO_INT(g_ptr_array_index(f->blocks,i)));
-    g_ptr_array_free(f->blocks,TRUE);
-    g_free(f->name); g_free(f);
+    if(data) fs_fcb_release(data);
 }
 
 /*──────────────── criar novo nó Dir ───*/
@@ -50,13 +98,23 @@ static Dir *_dir_new(const char *name,Dir *parent)
 
     d->owner = auth_uid();
     d->group = auth_gid();
+    d->ino   = VOL_NO_INODE;
 
     d->subdirs = g_tree_new_full(_cmp,NULL,g_free,NULL);
     d->files   = g_hash_table_new_full(
                     g_str_hash,g_str_equal,g_free,_destroy_fcb);
+    g_rw_lock_init(&d->lock);
     return d;
 }
 
+static void _dir_free(Dir *d)
+{
+    g_rw_lock_clear(&d->lock);
+    g_tree_destroy(d->subdirs);
+    g_hash_table_destroy(d->files);
+    g_free(d->name); g_free(d);
+}
+
 /*──────────────── init raiz ───────────*/
 void dir_init(void)
 {
@@ -65,17 +123,60 @@ void dir_init(void)
     root->perms = 0755;              /* raiz sempre pública leitura/x   */
     root->owner = 0;
     root->group = 0;
-    cwd  = root;
+    root->ino   = VOL_ROOT_INO;
 }
 
-Dir *dir_get_cwd(void){ return cwd; }
+/*──────────────── árvore a partir da tabela de inodes ─────*/
+/* diretórios primeiro (pais podem vir depois dos filhos), depois arquivos */
+int dir_mount(void)
+{
+    if(!vol_active()) return 0;
+
+    const VolInode *ri=vol_inode(VOL_ROOT_INO);
+    if(!ri||ri->kind!=VI_DIR) return -1;
+    root->owner=ri->owner; root->group=ri->group; root->perms=ri->perms;
+
+    uint32_t hwm=vol_inode_hwm();
+    Dir **byino=g_new0(Dir*,hwm);
+    byino[VOL_ROOT_INO]=root;
+
+    for(uint32_t i=1;i<hwm;++i){
+        const VolInode *vi=vol_inode(i);
+        if(vi->kind!=VI_DIR) continue;
+        Dir *d=_dir_new(vi->name,NULL);
+        d->owner=vi->owner; d->group=vi->group; d->perms=vi->perms;
+        d->ino=i;
+        byino[i]=d;
+    }
+    for(uint32_t i=1;i<hwm;++i){
+        Dir *d=byino[i]; if(!d) continue;
+        uint32_t p=vol_inode(i)->parent;
+        d->parent=(p<hwm&&byino[p]&&p!=i)?byino[p]:root;   /* órfão → raiz */
+        g_tree_insert(d->parent->subdirs,g_strdup(d->name),d);
+    }
+    for(uint32_t i=1;i<hwm;++i){
+        const VolInode *vi=vol_inode(i);
+        if(vi->kind!=VI_FILE) continue;
+        Dir *p=(vi->parent<hwm&&byino[vi->parent])?byino[vi->parent]:root;
+        if(fs_mount_file(p,i)){ g_free(byino); return -1; }
+    }
+    g_free(byino);
+    dir_invalidate();
+    return 0;
+}
+
+Dir *dir_get_cwd(void)
+{
+    Dir *c=session_current()->cwd;
+    return c?c:root;
+}
 
 /*──────────────── pwd ─────────────────*/
 const char *dir_pwd(char *buf,size_t n)
 {
     if(!buf||!n) return NULL;
     GPtrArray *stk=g_ptr_array_new();
-    for(Dir*d=cwd;d;d=d->parent) g_ptr_array_add(stk,d);
+    for(Dir*d=dir_get_cwd();d;d=d->parent) g_ptr_array_add(stk,d);
 
     buf[0]='\0';
     for(gint i=stk->len-1;i>=0;--i){
@@ -88,15 +189,38 @@ const char *dir_pwd(char *buf,size_t n)
 }
 
 /*──────────────── mkdir ───────────────*/
-int dir_mkdir(const char *name)
+static Dir *_resolve(Dir *base,const char *path);
+
+static int _mkdir(const char *path)
 {
-    if(!cwd||!name||!*name||strchr(name,'/')) return -1;
-    if(!dir_has_perm(cwd,P_WRITE|P_EXEC)) { puts("Permissão negada"); return -1; }
-    if(g_tree_lookup(cwd->subdirs,name))  return -1;
+    if(!root||!path||!*path) return -1;
+    Dir *at=dir_get_cwd();                       /* "a/b/novo" → a/b   */
+    const char *name=strrchr(path,'/');
+    if(name){
+        char *dp=g_strndup(path,(gsize)(name-path));
+        at=_resolve(NULL,*dp?dp:"/");
+        g_free(dp);
+        ++name;
+        if(!at) return -1;
+    } else name=path;
+    if(!*name||strlen(name)>DIR_NAME_MAX) return -1;
+    if(!dir_has_perm(at,P_WRITE|P_EXEC)) { session_puts("Permissão negada"); return -1; }
 
-    Dir*nd=_dir_new(name,cwd);
-    g_tree_insert(cwd->subdirs,g_strdup(name),nd);
-    return 0;
+    /* checagem e inserção sob a mesma trava: dois mkdir do mesmo nome
+     * em threads diferentes não criam dois nós                        */
+    int rc=-1;
+    jnl_begin();                                 /* antes de travar    */
+    g_rw_lock_writer_lock(&at->lock);
+    if(!g_tree_lookup(at->subdirs,name)){
+        Dir*nd=_dir_new(name,at);
+        if(vol_active()&&(nd->ino=vol_ialloc())!=VOL_NO_INODE) vol_put_dir(nd);
+        if(nd->ino==VOL_NO_INODE&&vol_active()) _dir_free(nd);
+        else { g_tree_insert(at->subdirs,g_strdup(name),nd); rc=0; }
+    }
+    g_rw_lock_writer_unlock(&at->lock);
+    jnl_end();
+    if(!rc) dir_invalidate();
+    return rc;
 }
 
 /*──────────────── resolver componente ---*/
@@ -104,32 +228,90 @@ static Dir *_step(Dir *cur,const char *comp)
 {
     if(strcmp(comp,".")==0)  return cur;
     if(strcmp(comp,"..")==0) return cur->parent?cur->parent:cur;
-    return g_tree_lookup(cur->subdirs,comp);
+    g_rw_lock_reader_lock(&cur->lock);
+    Dir *d=g_tree_lookup(cur->subdirs,comp);
+    g_rw_lock_reader_unlock(&cur->lock);
+    return d;
+}
+
+/* X em `d` para as credenciais da sessão, lembrado enquanto a ficha vale */
+static bool _can_exec(Dir *d,gint tok)
+{
+    if(g_atomic_int_get(&d->x_tok)==tok) return true;
+    if(!dir_has_perm(d,P_EXEC)) return false;
+    g_atomic_int_set(&d->x_tok,tok); return true;
 }
 
 /*──────────────── resolver caminho (checa X a cada passo) ───────────*/
-static Dir *_resolve(const char *path)
+static Dir *_walk(Dir *cur,const char *path,gint tok)
 {
-    Dir *cur = (*path=='/')? root : cwd;
-    if(!dir_has_perm(cur,P_EXEC)) return NULL;
+    if(!_can_exec(cur,tok)) return NULL;
 
-    gchar **parts = g_strsplit(path,"/",-1);
-    for(gchar **p=parts;*p;++p){
-        if(**p=='\0') continue;
-        cur = _step(cur,*p);
-        if(!cur || !dir_has_perm(cur,P_EXEC)){ cur=NULL; break; }
+    char comp[DIR_NAME_MAX+1];
+    for(const char *p=path;*p;){
+        while(*p=='/') ++p;
+        size_t n=strcspn(p,"/");
+        if(!n) break;
+        if(n>DIR_NAME_MAX) return NULL;
+        memcpy(comp,p,n); comp[n]='\0'; p+=n;
+        cur = _step(cur,comp);
+        if(!cur || !_can_exec(cur,tok)) return NULL;
     }
-    g_strfreev(parts);
     return cur;
 }
 
+/* acerto = uma consulta de hash; falha = caminhada + nova entrada */
+static Dir *_resolve_at(Dir *base,const char *path)
+{
+    Session *s = session_current();
+    Dir *start = (*path=='/')? root : base? base : dir_get_cwd();
+    DKey key   = { start, path };
+    gint tok   = _token(s);
+
+    if(!s->dcache)
+        s->dcache=g_hash_table_new_full(_dk_hash,_dk_equal,g_free,g_free);
+    GHashTable *dcache=s->dcache;
+    DEnt *e = g_hash_table_lookup(dcache,&key);
+    if(e && e->tok==tok) return e->dir;
+
+    Dir *d = _walk(start,path,tok);
+    if(!d) return NULL;
+    if(!e){
+        if(g_hash_table_size(dcache)>=DCACHE_MAX) g_hash_table_remove_all(dcache);
+        size_t len=strlen(path)+1;
+        DKey *k=g_malloc(sizeof *k+len);
+        k->start=start;
+        k->path =memcpy(k+1,path,len);
+        e=g_new(DEnt,1);
+        g_hash_table_insert(dcache,k,e);
+    }
+    e->dir=d; e->tok=tok;
+    return d;
+}
+
+static Dir *_resolve(Dir *base,const char *path)
+{
+    if(!TRACE_ON()) return _resolve_at(base,path);
+    uint64_t t0=trace_now();
+    Dir *d=_resolve_at(base,path);
+    trace_emit(ST_DIR_RESOLVE,t0,trace_hash(path),0,0,d?0:-1);
+    return d;
+}
+
+Dir *dir_resolve(Dir *base,const char *path)
+{
+    Dir *d=(path&&*path)?_resolve(base,path):NULL;
+    stats_count(ST_DIR_RESOLVE,d?0:-1);
+    return d;
+}
+
 /*──────────────── cd ─────────────────*/
-int dir_cd(const char *path)
+static int _cd(const char *path)
 {
     if(!path||!*path) return -1;
-    Dir *d=_resolve(path);
-    if(!d) { puts("Permissão negada ou diretório inex."); return -1; }
-    cwd=d; return 0;
+    Dir *d=_resolve(NULL,path);
+    if(!d) { session_puts("Permissão negada ou diretório inex."); return -1; }
+    session_current()->cwd=d; return 0;
 }
 
 /*──────────────── impressão ls helper ─*/
@@ -137,24 +319,45 @@ static gboolean _print_one(gpointer k,gpointer v,gpointer d)
 {
     (void)v;
     gboolean longf = GPOINTER_TO_INT(d);
-    if(longf) g_print("<DIR>\t%s/\n",(char*)k);
-    else      g_print("%s/\t",(char*)k);
+    if(longf) session_printf("<DIR>\t%s/\n",(char*)k);
+    else      session_printf("%s/\t",(char*)k);
     return FALSE;
 }
 
 /*──────────────── ls ─────────────────*/
-void dir_ls(gboolean longf)
+static int _ls(gboolean longf)
 {
-    if(!cwd) return;
-    if(!dir_has_perm(cwd,P_READ)) { puts("Permissão negada"); return; }
+    if(!root) return -1;
+    Dir *cwd=dir_get_cwd();
+    if(!dir_has_perm(cwd,P_READ)) { session_puts("Permissão negada"); return -1; }
 
+    g_rw_lock_reader_lock(&cwd->lock);
     g_tree_foreach(cwd->subdirs,_print_one,GINT_TO_POINTER(longf));
 
     GHashTableIter it; gpointer k,v;
     g_hash_table_iter_init(&it,cwd->files);
     while(g_hash_table_iter_next(&it,&k,&v)){
-        if(longf) g_print("     \t%s\n",(char*)k);
-        else      g_print("%s\t",(char*)k);
+        if(longf) session_printf("     \t%s\n",(char*)k);
+        else      session_printf("%s\t",(char*)k);
     }
-    if(!longf) putchar('\n');
+    g_rw_lock_reader_unlock(&cwd->lock);
+    if(!longf) fputc('\n',session_out());
+    return 0;
+}
+
+/*──────────────── entradas medidas (stats) ─*/
+int dir_mkdir(const char *path)
+{
+    uint64_t t0=stats_now(); int rc=_mkdir(path);
+    stats_done(ST_DIR_MKDIR,t0,rc); return rc;
+}
+int dir_cd(const char *path)
+{
+    uint64_t t0=stats_now(); int rc=_cd(path);
+    stats_done(ST_DIR_CD,t0,rc); return rc;
+}
+void dir_ls(gboolean longf)
+{
+    uint64_t t0=stats_now(); int rc=_ls(longf);
+    stats_done(ST_DIR_LS,t0,rc); (void)rc;
 }
@@ -0,0 +1,122 @@
+#include "extent.h"
+
+#define EXT(m,i)  g_array_index((m), Extent, (i))
+
+/*──────────────── criação / destruição ────────────────────*/
+GArray *ext_new(void)
+{
+    return g_array_new(FALSE, FALSE, sizeof(Extent));
+}
+
+void ext_free(GArray *map)
+{
+    if (map) g_array_free(map, TRUE);
+}
+
+/*──────────────── consultas ───────────────────────────────*/
+uint32_t ext_blocks(const GArray *map)
+{
+    uint32_t n = 0;
+    for (guint i = 0; i < map->len; ++i) n += EXT(map, i).len;
+    return n;
+}
+
+uint32_t ext_end(const GArray *map)
+{
+    if (!map->len) return 0;
+    const Extent *e = &EXT(map, map->len - 1);
+    return e->lblk + e->len;
+}
+
+/* índice do primeiro extent com lblk > alvo (busca binária) */
+static guint _upper(const GArray *map, uint32_t lblk)
+{
+    guint lo = 0, hi = map->len;
+    while (lo < hi) {
+        guint mid = (lo + hi) / 2;
+        if (EXT(map, mid).lblk <= lblk) lo = mid + 1;
+        else                            hi = mid;
+    }
+    return lo;
+}
+
+uint32_t ext_find(const GArray *map, uint32_t lblk, uint32_t *pblk)
+{
+    guint i = _upper(map, lblk);
+    if (i > 0) {
+        const Extent *e = &EXT(map, i - 1);
+        if (lblk < e->lblk + e->len) {
+            *pblk = e->pblk + (lblk - e->lblk);
+            return e->len - (lblk - e->lblk);
+        }
+    }
+    *pblk = EXT_HOLE;
+    return (i < map->len) ? EXT(map, i).lblk - lblk : UINT32_MAX - lblk;
+}
+
+/*──────────────── inserção com fusão de vizinhos ──────────*/
+void ext_insert(GArray *map, uint32_t lblk, uint32_t pblk, uint32_t n)
+{
+    if (!n) return;
+    guint i = _upper(map, lblk);
+
+    /* cola no anterior se lógico e físico forem contíguos */
+    if (i > 0) {
+        Extent *p = &EXT(map, i - 1);
+        if (p->lblk + p->len == lblk && p->pblk + p->len == pblk) {
+            p->len += n;
+            if (i < map->len) {                       /* e talvez no próximo */
+                Extent *q = &EXT(map, i);
+                if (q->lblk == p->lblk + p->len && q->pblk == p->pblk + p->len) {
+                    p->len += q->len;
+                    g_array_remove_index(map, i);
+                }
+            }
+            return;
+        }
+    }
+    if (i < map->len) {
+        Extent *q = &EXT(map, i);
+        if (lblk + n == q->lblk && pblk + n == q->pblk) {
+            q->lblk = lblk; q->pblk = pblk; q->len += n;
+            return;
+        }
+    }
+    Extent e = { lblk, pblk, n };
+    g_array_insert_val(map, i, e);
+}
+
+/*──────────────── remoção de faixa ────────────────────────*/
+void ext_punch(GArray *map, uint32_t lblk, uint32_t n, ExtReleaseFn release)
+{
+    if (!n) return;
+    uint64_t end = (uint64_t)lblk + n;
+    guint i = _upper(map, lblk);
+    if (i > 0 && EXT(map, i - 1).lblk + EXT(map, i - 1).len > lblk) --i;
+
+    while (i < map->len) {
+        Extent *e = &EXT(map, i);
+        uint64_t e_end = (uint64_t)e->lblk + e->len;
+        if (e->lblk >= end) break;
+
+        uint32_t a = MAX(e->lblk, lblk);               /* interseção [a,b) */
+        uint32_t b = (uint32_t)MIN(e_end, end);
+        if (release) release(e->pblk + (a - e->lblk), b - a);
+
+        if (a == e->lblk && b == e_end) {              /* inteiro           */
+            g_array_remove_index(map, i);
+            continue;
+        }
+        if (a == e->lblk) {                            /* corta o início    */
+            e->pblk += b - a; e->len -= b - a; e->lblk = b;
+        } else if (b == e_end) {                       /* corta o fim       */
+            e->len = a - e->lblk;
+        } else {                                       /* parte em dois     */
+            Extent tail = { b, e->pblk + (b - e->lblk), (uint32_t)(e_end - b) };
+            e->len = a - e->lblk;
+            g_array_insert_val(map, i + 1, tail);
+            ++i;
+        }
+        ++i;
+    }
+}
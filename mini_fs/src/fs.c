@@ -1,10 +1,25 @@
 #include "fs.h"
 #include "auth.h"
+#include "volume.h"
+#include "journal.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>     /* STDOUT_FILENO */
 
-/*  simples contador de inodes (único) ------------------------------- */
-static uint32_t next_inode = 1;
+#define FS_ZERO_SPAN (1u << 16)     /* trecho de zeros p/ buracos    */
+#define FS_IOV_BATCH 256            /* iovecs por writev (sendfile)  */
+#define FS_CAT_DIRECT (1u << 16)    /* cat maior sai por writev      */
+#define FS_PATH_MAX  1024           /* parte-diretório de um caminho */
+
+static const char _zeros[FS_ZERO_SPAN];
+
+/*  simples contador de inodes (único, atômico) ---------------------- */
+static gint next_inode = 1;
+static bool _zip_dflt;              /* FS_F_ZIP: valor inicial de FCB.zip */
 
 /*  cria FCB inicializado consoante máscara-padrão do usuário -------- */
 /* define permissões máximas conforme classe do usuário */
@@ -15,197 +30,967 @@ static uint16_t _file_default_perms(void)
     return 0666;                                     /* público */
 }
 
-static FCB *_new_fcb(const char *name)
+static FCB *_new_fcb(Dir *dir, const char *name)
 {
+    uint32_t ino = vol_active() ? vol_ialloc()
+                                : (uint32_t)g_atomic_int_add(&next_inode, 1);
+    if (ino == VOL_NO_INODE) return NULL;           /* tabela cheia */
+
     FCB *f    = g_new0(FCB, 1);
     f->name   = g_strdup(name);
-    f->inode  = next_inode++;
+    f->dir    = dir;
+    f->inode  = ino;
     f->owner  = auth_uid();
     f->group  = auth_gid();
     f->perms  = _file_default_perms();
+    f->zip    = _zip_dflt;
     f->type   = F_DATA;
     f->created = f->modified = f->accessed = time(NULL);
-    f->blocks  = g_ptr_array_new_with_free_func(NULL);
+    f->refs    = 1;              /* entrada na pasta; nasce inline (vazio) */
+    g_rw_lock_init(&f->lock);
     return f;
 }
 
 /*───────────────────────────────────────────────────────────*/
-void fs_init(void)
+int fs_init(const char *image, size_t nblocks, size_t block_sz, unsigned flags)
 {
-    block_init();
+    _zip_dflt = flags & FS_F_ZIP;
+    if (image) { if (vol_open(image, nblocks, block_sz)) return -1; }
+    else if (block_init(nblocks, block_sz, flags & ~FS_F_ZIP)) return -1;
     dir_init();
+    return dir_mount();
+}
+
+int  fs_sync(void)     { return vol_sync(); }
+void fs_shutdown(void) { vol_close(); }
+
+/* refaz as máscaras dos fragmentos dos blocos comprimidos do mapa */
+static int _claim_z(const GArray *map)
+{
+    for (guint i = 0; i < map->len; ++i) {
+        const Extent *e = &g_array_index(map, Extent, i);
+        for (uint32_t k = 0; (e->pblk & BLOCK_Z) && k < e->len; ++k)
+            if (block_zclaim(e->pblk + k)) return -1;
+    }
+    return 0;
+}
+
+/* recria um FCB a partir do inode persistido (dir_mount) ------------ */
+int fs_mount_file(Dir *parent, uint32_t ino)
+{
+    const VolInode *vi = vol_inode(ino);
+    if (!vi || vi->kind != VI_FILE) return -1;
+
+    FCB *f      = g_new0(FCB, 1);
+    f->name     = g_strdup(vi->name);
+    f->dir      = parent;
+    f->inode    = ino;
+    f->owner    = vi->owner;
+    f->group    = vi->group;
+    f->perms    = vi->perms;
+    f->type     = (ftype_t)vi->ftype;
+    f->size     = vi->size;
+    f->created  = vi->created;
+    f->modified = vi->modified;
+    f->accessed = vi->accessed;
+    f->zip      = vi->flags & VI_F_ZIP;
+    f->refs     = 1;
+    g_rw_lock_init(&f->lock);
+    if (!(vi->flags & VI_F_INLINE) && vi->tail_cap) {
+        f->tail_blk = vi->tail_blk;
+        f->tail_off = vi->tail_off;
+        f->tail_cap = vi->tail_cap;
+        if (block_frag_claim((int)f->tail_blk, f->tail_off, f->tail_cap)) {
+            g_free(f->name); g_free(f);
+            return -1;
+        }
+    }
+    if (vi->flags & VI_F_INLINE) {
+        if (f->size > FS_INLINE_MAX) { g_free(f->name); g_free(f); return -1; }
+        memcpy(f->inl, vi->data, f->size);
+    } else if (vol_get_extents(ino, f->extents = ext_new()) || _claim_z(f->extents)) {
+        ext_free(f->extents); g_free(f->name); g_free(f);
+        return -1;
+    }
+    g_hash_table_insert(parent->files, g_strdup(f->name), f);
+    return 0;
+}
+
+/* fim da vida de um FCB: quando cai a última referência – a da pasta
+ * (remoção), de um handle ou de uma operação em curso noutra thread.
+ * Até lá o arquivo removido fica órfão, dir == NULL                   */
+static void _release(uint32_t pblk, uint32_t n);
+
+static void _free_fcb(FCB *f)
+{
+    if (vol_active()) vol_ifree(f->inode);
+    if (f->tail_cap) block_frag_free((int)f->tail_blk, f->tail_off, f->tail_cap);
+    for (guint i = 0; f->extents && i < f->extents->len; ++i) {
+        Extent *e = &g_array_index(f->extents, Extent, i);
+        _release(e->pblk, e->len);
+    }
+    if (f->extents) ext_free(f->extents);
+    g_rw_lock_clear(&f->lock);
+    g_free(f->name); g_free(f);
+}
+
+static void _put(FCB *f)
+{
+    if (f && g_atomic_int_dec_and_test(&f->refs)) _free_fcb(f);
+}
+
+/* chamado com a pasta travada para escrita (ordem: pasta → FCB) */
+void fs_fcb_release(FCB *f)
+{
+    g_rw_lock_writer_lock(&f->lock);
+    f->dir = NULL;
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+}
+
+/* grava atributos (e o mapa, se mudou) no inode do volume ----------- */
+static void _persist(FCB *f, bool extents)
+{
+    if (!vol_active() || !f->dir) return;           /* órfão: só na memória */
+    if (vol_put_file(f, f->dir->ino, extents))
+        session_puts("volume: sem blocos para o mapa de extents");
 }
 
 /*  helpers internos --------------------------------------- */
-static FCB *_lookup(const char *name)
+/* separa "a/b/arq" em diretório (resolvido a partir de base, NULL = cwd;
+ * absoluto se começa com '/') e nome final; NULL se não resolve         */
+static Dir *_at(Dir *base, const char *path, const char **leaf)
+{
+    *leaf = NULL;
+    if (!path || !*path) return NULL;
+    const char *slash = strrchr(path, '/');
+    if (!slash) { *leaf = path; return base ? base : dir_get_cwd(); }
+
+    *leaf = slash + 1;
+    size_t n = (size_t)(slash - path);
+    if (!**leaf || n >= FS_PATH_MAX) return NULL;
+    char dpath[FS_PATH_MAX];
+    if (n) { memcpy(dpath, path, n); dpath[n] = '\0'; }
+    else   strcpy(dpath, "/");
+    return dir_resolve(base, dpath);
+}
+
+/* busca e fixa: o FCB devolvido vale até o _put, mesmo se removido */
+static FCB *_get(Dir *d, const char *name)
 {
-    Dir *cwd = dir_get_cwd();
-    return cwd ? g_hash_table_lookup(cwd->files, name) : NULL;
+    if (!d) return NULL;
+    g_rw_lock_reader_lock(&d->lock);
+    FCB *f = g_hash_table_lookup(d->files, name);
+    if (f) g_atomic_int_inc(&f->refs);
+    g_rw_lock_reader_unlock(&d->lock);
+    return f;
 }
 
-/* verifica permissões no diretório atual */
-/* auxiliar para checar permissão no diretório atual */
-static Dir *_cwd_if_perm(uint16_t perm)
+/* permissão no próprio arquivo (perms/dono mudam sob a trava dele) */
+static bool _allowed(FCB *f, uint16_t bit)
 {
-    Dir *cwd = dir_get_cwd();
-    if (!cwd || !dir_has_perm(cwd,perm)) {
-        puts("Permissão negada");
+    g_rw_lock_reader_lock(&f->lock);
+    bool ok = auth_has_perm(f, bit);
+    g_rw_lock_reader_unlock(&f->lock);
+    if (!ok) session_puts("Permissão negada");
+    return ok;
+}
+
+/* verifica permissões no diretório do arquivo */
+static Dir *_dir_if_perm(Dir *d, uint16_t perm)
+{
+    if (!d) return NULL;                            /* caminho inválido */
+    if (!dir_has_perm(d,perm)) {
+        session_puts("Permissão negada");
         return NULL;
     }
-    return cwd;
+    return d;
 }
 
-static int _ensure_capacity(FCB *f, size_t new_sz)
+/* zera [bo, bo+len) de uma faixa física, em pedaços de _zeros */
+static void _fill_zero(uint32_t pb, uint32_t run, size_t bo, size_t len)
 {
-    size_t need = (new_sz + BLOCK_SIZE - 1) / BLOCK_SIZE;
-    while (f->blocks->len < need) {
-        int idx = block_alloc();
+    while (len) {
+        size_t n = block_write_run((int)pb, run, _zeros, MIN(len, sizeof _zeros), bo);
+        if (!n) return;
+        bo += n; len -= n;
+    }
+}
+
+/* mapeia os buracos de [off, end) com faixas contíguas do block.c.
+ * Blocos novos chegam com lixo: zera só o que cai antes do EOF e fora
+ * de [off, end) quando `wr` (a escrita vai cobrir o resto); o que fica
+ * além do EOF é zerado quando o arquivo crescer até lá (_zero).
+ * Retorna quantas faixas mapeou ou −1                                   */
+static int _map(FCB *f, size_t off, size_t end, bool wr)
+{
+    if (end <= off) return 0;
+    size_t   bs   = block_size();
+    uint32_t lb   = (uint32_t)(off / bs);
+    uint32_t last = (uint32_t)((end - 1) / bs);
+    int      runs = 0;
+
+    while (lb <= last) {
+        uint32_t pb, run = ext_find(f->extents, lb, &pb);
+        run = MIN(run, last - lb + 1);
+        if (pb != EXT_HOLE) { lb += run; continue; }
+
+        size_t got;
+        int idx = block_alloc_range(run, &got);
         if (idx < 0) return -1;
-        g_ptr_array_add(f->blocks, GINT_TO_POINTER(idx));
+        ext_insert(f->extents, lb, (uint32_t)idx, (uint32_t)got);
+        ++runs;
+
+        size_t lo = (size_t)lb * bs, hi = MIN(lo + got * bs, f->size);
+        if (wr) {
+            if (lo < MIN(off, hi)) _fill_zero((uint32_t)idx, (uint32_t)got, 0, MIN(off, hi) - lo);
+            if (end < hi)          _fill_zero((uint32_t)idx, (uint32_t)got, end - lo, hi - end);
+        } else if (lo < hi) {
+            _fill_zero((uint32_t)idx, (uint32_t)got, 0, hi - lo);
+        }
+        lb += (uint32_t)got;
     }
-    return 0;
+    return runs;
 }
 
-/*──────────────────── criação vazia ───────────────────────*/
-int fs_touch(const char *name)
+/* solta [pblk, pblk+n) do mapa; ids comprimidos um a um */
+static void _release(uint32_t pblk, uint32_t n)
 {
-    Dir *cwd = _cwd_if_perm(P_WRITE);
-    if (!cwd || !name || !*name || strchr(name,'/')) return -1;
-    if (g_hash_table_contains(cwd->files, name))     return -1;
+    if (!(pblk & BLOCK_Z)) { block_free_range((int)pblk, n); return; }
+    for (uint32_t i = 0; i < n; ++i) block_zfree(pblk + i);
+}
 
-    g_hash_table_insert(cwd->files, g_strdup(name), _new_fcb(name));
-    return 0;
+/* copy-on-write: troca blocos compartilhados em [off, off+len) por cópias
+ * exclusivas antes de escrever (uma faixa nova por trecho compartilhado);
+ * retorna quantas faixas trocou (o mapa mudou) ou −1                    */
+static int _unshare(FCB *f, size_t off, size_t len)
+{
+    if (!len) return 0;
+    size_t   bs   = block_size();
+    uint32_t lb   = (uint32_t)(off / bs);
+    uint32_t last = (uint32_t)((off + len - 1) / bs);
+    int      swaps = 0;
+
+    while (lb <= last) {
+        uint32_t pb, run = ext_find(f->extents, lb, &pb);
+        if (pb == EXT_HOLE) { if (run > last - lb) break; lb += run; continue; }
+        run = MIN(run, last - lb + 1);
+
+        uint32_t n = 0;                              /* prefixo exclusivo */
+        while (n < run && block_refcount((int)(pb + n)) <= 1) ++n;
+        if (n) { lb += n; continue; }
+
+        while (n < run && block_refcount((int)(pb + n)) > 1) ++n;
+        size_t got;
+        int nb = block_alloc_range(n, &got);
+        if (nb < 0) return -1;
+        block_copy(nb, (int)pb, got);
+        ext_punch (f->extents, lb, (uint32_t)got, _release);
+        ext_insert(f->extents, lb, (uint32_t)nb, (uint32_t)got);
+        lb += (uint32_t)got;
+        ++swaps;
+    }
+    return swaps;
 }
 
-/*──────────────────── escrita / append ─────────────────────*/
-int fs_echo(const char *name, const char *txt, int append)
+/*  cauda empacotada --------------------------------------------------- *
+ *  Com tail_cap ≠ 0 os bytes [at, size), at = size arredondado para     *
+ *  baixo ao bloco, moram num fragmento (block_frag_*) e o bloco lógico  *
+ *  at/bs não está no mapa. Só a leitura o acessa direto; quem muda o    *
+ *  mapa desempacota antes (_unpack) e empacota de novo no fim (_pack).  */
+static inline bool   _tail(const FCB *f)    { return f->tail_cap != 0; }
+static inline size_t _tail_at(const FCB *f) { return f->size / block_size() * block_size(); }
+static inline const char *_tail_ptr(const FCB *f)
+{ return (const char *)block_data((int)f->tail_blk, 1) + f->tail_off; }
+
+/* bloco comprimido no mapa (block_z*) */
+static inline bool _z(uint32_t pb) { return pb != EXT_HOLE && (pb & BLOCK_Z); }
+
+/* copia entre buffer e arquivo, um memcpy por trecho contíguo;
+ * buracos são lidos como zeros e interrompem a escrita; um bloco
+ * comprimido que não descomprime interrompe a leitura ---------------- */
+static size_t _xfer(FCB *f, size_t off, void *buf, size_t len, int wr)
 {
-    if (!name || !txt) return -1;
-    size_t len = strlen(txt);
+    size_t bs = block_size(), done = 0, at = _tail(f) ? _tail_at(f) : SIZE_MAX;
+    while (done < len) {
+        size_t pos = off + done, bo = pos % bs;
+        if (pos >= at) {                         /* cauda: lida até o EOF */
+            if (wr) break;
+            memcpy((char *)buf + done, _tail_ptr(f) + (pos - at), len - done);
+            return len;
+        }
+        uint32_t pb, run = ext_find(f->extents, (uint32_t)(pos / bs), &pb);
+        if ((pb == EXT_HOLE || _z(pb)) && wr) break;
+
+        size_t chunk = (size_t)(_z(pb) ? 1 : run) * bs - bo;
+        if (chunk > len - done) chunk = len - done;
+        if (chunk > at - pos)   chunk = at - pos;
+        if (pb == EXT_HOLE) memset((char *)buf + done, 0, chunk);
+        else if (_z(pb)) { if (block_zread(pb, (char *)buf + done, chunk, bo) != chunk) break; }
+        else if (wr) block_write_run((int)pb, run, (const char *)buf + done, chunk, bo);
+        else         block_read_run ((int)pb, run, (char *)buf + done, chunk, bo);
+        done += chunk;
+    }
+    return done;
+}
 
-    FCB *f = _lookup(name);
-    if (!f) {                       /* cria se não existe          */
-        if (fs_touch(name)) return -1;
-        f = _lookup(name);
+/* zera os bytes mapeados de [off, off+len) (resto velho além do EOF);
+ * buracos já são lidos como zeros e são pulados                      */
+static void _zero(FCB *f, size_t off, size_t len)
+{
+    size_t bs = block_size(), end = off + len;
+    while (off < end) {
+        uint32_t pb, run = ext_find(f->extents, (uint32_t)(off / bs), &pb);
+        size_t   bo = off % bs, n = MIN((size_t)run * bs - bo, end - off);
+        if (pb != EXT_HOLE) _fill_zero(pb, run, bo, n);
+        off += n;
     }
+}
 
-    if (!auth_has_perm(f, P_WRITE)) {
-        puts("Permissão negada");
+/*  dados inline ------------------------------------------------------ *
+ *  Sem mapa (extents == NULL) os bytes ficam em f->inl, zerado além do  *
+ *  size. Passar de FS_INLINE_MAX promove a blocos; encolher até caber   *
+ *  (_resize) devolve os blocos e volta ao inline.                       */
+static inline bool _inline(const FCB *f) { return !f->extents; }
+
+static int _promote(FCB *f)
+{
+    uint8_t tmp[FS_INLINE_MAX];
+    size_t  n = f->size;
+    memcpy(tmp, f->inl, n);
+    f->extents = ext_new();
+    if (_map(f, 0, n, true) < 0) {
+        ext_punch(f->extents, 0, ext_end(f->extents), _release);
+        ext_free(f->extents); f->extents = NULL;
         return -1;
     }
+    _xfer(f, 0, tmp, n, 1);
+    memset(f->inl, 0, sizeof f->inl);
+    return 0;
+}
 
-    size_t offset = append ? f->size : 0;
-    size_t new_sz = offset + len;
-    if (_ensure_capacity(f, new_sz)) return -1;
+static int _demote(FCB *f, size_t sz)
+{
+    uint8_t tmp[FS_INLINE_MAX] = { 0 };
+    size_t  n = MIN(sz, f->size);
+    if (_xfer(f, 0, tmp, n, 0) != n) return -1;
+    if (_tail(f)) block_frag_free((int)f->tail_blk, f->tail_off, f->tail_cap);
+    f->tail_cap = 0;
+    ext_punch(f->extents, 0, ext_end(f->extents), _release);
+    ext_free(f->extents); f->extents = NULL;
+    memcpy(f->inl, tmp, sizeof tmp);
+    return 0;
+}
 
-    size_t rem = len, pos = 0;
-    while (rem) {
-        size_t bi = (offset + pos) / BLOCK_SIZE;
-        size_t bo = (offset + pos) % BLOCK_SIZE;
-        size_t chunk = BLOCK_SIZE - bo;
-        if (chunk > rem) chunk = rem;
+/* cauda → bloco próprio; 1 se desempacotou, 0 se não havia, −1 sem espaço */
+static int _unpack(FCB *f)
+{
+    if (!_tail(f)) return 0;
+    size_t      at  = _tail_at(f);
+    const char *src = _tail_ptr(f);
+    uint32_t    cap = f->tail_cap;
+    f->tail_cap = 0;                             /* _map vê o buraco */
+    if (_map(f, at, f->size, true) < 0) { f->tail_cap = cap; return -1; }
+    _xfer(f, at, (void *)src, f->size - at, 1);
+    block_frag_free((int)f->tail_blk, f->tail_off, cap);
+    return 1;
+}
 
-        int phys = GPOINTER_TO_INT(g_ptr_array_index(f->blocks, bi));
-        block_write(phys, txt + pos, chunk, bo);
+/* cauda parcial de até meio bloco → fragmento; o bloco dela é solto.
+ * true se o mapa mudou                                              */
+static bool _pack(FCB *f)
+{
+    size_t   bs = block_size(), at = f->size / bs * bs, n = f->size - at;
+    uint32_t lb = (uint32_t)(at / bs), pb, off, cap;
+    if (_inline(f) || _tail(f) || !n || n > bs / 2) return false;
+    if (ext_end(f->extents) != lb + 1)             return false;
+    ext_find(f->extents, lb, &pb);
+    if (pb == EXT_HOLE)                            return false;
+
+    int blk = block_frag_alloc(n, &off, &cap);
+    if (blk < 0) return false;                   /* fica no bloco mesmo */
+    block_write(blk, block_data((int)pb, 1), n, off);
+    ext_punch(f->extents, lb, 1, _release);
+    f->tail_blk = (uint32_t)blk;
+    f->tail_off = off;
+    f->tail_cap = cap;
+    return true;
+}
+
+/*  blocos comprimidos ------------------------------------------------ *
+ *  Com f->zip, ao fim de cada escrita os blocos selados que ela tocou   *
+ *  (cheios, antes do último bloco) viram fragmentos comprimidos e o id  *
+ *  (block_zpack) toma o lugar do bloco no mapa. Só a leitura os usa     *
+ *  assim; quem vai alterá-los descomprime antes (_inflate). O último    *
+ *  bloco nunca é comprimido: _zero, _pack e o crescimento só mexem nele */
+/* bloco descomprimido fora do cache (_iov, _inflate): um por thread,
+ * vale até a próxima leitura de bloco comprimido da mesma thread     */
+static GPrivate _zb_key = G_PRIVATE_INIT(g_free);
 
-        pos += chunk; rem -= chunk;
+static uint8_t *_zbuf(void)
+{
+    size_t  bs = block_size();
+    size_t *b  = g_private_get(&_zb_key);
+    if (!b || *b < bs) {
+        b  = g_malloc(sizeof *b + bs);
+        *b = bs;
+        g_private_replace(&_zb_key, b);
     }
-    f->size = new_sz;
-    f->modified = time(NULL);
-    return (int)len;
+    return (uint8_t *)(b + 1);
 }
 
-/*──────────────────── leitura (cat) ───────────────────────*/
-int fs_cat(const char *name)
+/* comprimidos de [off, end) → blocos próprios; quantos trocou ou −1 */
+static int _inflate(FCB *f, size_t off, size_t end)
 {
-    Dir *cwd = _cwd_if_perm(P_READ|P_EXEC);
-    if (!cwd) return -1;
-    FCB *f = _lookup(name);
-    if (!f) return -1;
-    if (!auth_has_perm(f, P_READ)) {
-        puts("Permissão negada");
+    if (end <= off) return 0;
+    size_t   bs   = block_size();
+    uint32_t lb   = (uint32_t)(off / bs);
+    uint32_t last = (uint32_t)((end - 1) / bs);
+    int      swaps = 0;
+
+    while (lb <= last) {
+        uint32_t pb, run = ext_find(f->extents, lb, &pb);
+        if (!_z(pb)) { if (run > last - lb) break; lb += run; continue; }
+        uint8_t *tmp = _zbuf();
+        int      nb  = block_alloc();
+        if (nb < 0) return -1;
+        if (!block_zread(pb, tmp, bs, 0)) { block_free(nb); return -1; }
+        block_write(nb, tmp, bs, 0);
+        ext_punch (f->extents, lb, 1, _release);
+        ext_insert(f->extents, lb, (uint32_t)nb, 1);
+        ++lb; ++swaps;
+    }
+    return swaps;
+}
+
+/* bloco comprimido para outro arquivo: outro fragmento ou, sem
+ * contêiner, um bloco comum; EXT_HOLE sem espaço                 */
+static uint32_t _zcopy(uint32_t id)
+{
+    uint32_t nid = block_zdup(id);
+    if (nid) return nid;
+    uint8_t *tmp = _zbuf();
+    int      nb  = block_alloc();
+    if (nb < 0) return EXT_HOLE;
+    if (!block_zread(id, tmp, block_size(), 0)) { block_free(nb); return EXT_HOLE; }
+    block_write(nb, tmp, block_size(), 0);
+    return (uint32_t)nb;
+}
+
+/* comprime os blocos selados e exclusivos que [off, end) toca (os
+ * compartilhados por cp ficam como estão); quantos trocou          */
+static int _seal(FCB *f, size_t off, size_t end)
+{
+    size_t bs = block_size();
+    if (!f->zip || _inline(f) || !f->size) return 0;
+    uint32_t lb = (uint32_t)(off / bs);
+    uint32_t hi = (uint32_t)MIN((end + bs - 1) / bs, (f->size - 1) / bs);
+    int      n  = 0;
+
+    while (lb < hi) {
+        uint32_t pb, run = ext_find(f->extents, lb, &pb);
+        run = MIN(run, hi - lb);
+        for (uint32_t i = 0; pb != EXT_HOLE && !_z(pb) && i < run; ++i) {
+            uint32_t id;
+            if (block_refcount((int)(pb + i)) > 1 || !(id = block_zpack((int)(pb + i)))) continue;
+            ext_punch (f->extents, lb + i, 1, _release);
+            ext_insert(f->extents, lb + i, id, 1);
+            ++n;
+        }
+        lb += run;
+    }
+    return n;
+}
+
+/* núcleo de escrita posicional: mapeia só os blocos de [off, off+len),
+ * quebra COW e copia; se `off` passa do fim, [size, off) fica esparso e
+ * é lido como zeros (só o resto dos blocos já mapeados é zerado)       */
+static ssize_t _write_at(FCB *f, const void *buf, size_t len, size_t off)
+{
+    if (off + len < off) return -1;                        /* overflow */
+    size_t end   = off + len;
+    size_t from  = MIN(off, f->size);                     /* início sujo */
+
+    if (_inline(f)) {
+        if (end <= FS_INLINE_MAX) {            /* [size, off) já é zero */
+            memcpy(f->inl + off, buf, len);
+            if (end > f->size) f->size = end;
+            f->modified = time(NULL);
+            _persist(f, false);
+            return (ssize_t)len;
+        }
+        if (_promote(f)) return -1;
+    }
+    int unpacked = 0;
+    if (_tail(f)) {
+        size_t at = _tail_at(f);
+        if (off >= at && end <= at + f->tail_cap) {    /* cabe no fragmento */
+            if (off > f->size)
+                block_write((int)f->tail_blk, _zeros, off - f->size, f->tail_off + (f->size - at));
+            block_write((int)f->tail_blk, buf, len, f->tail_off + (off - at));
+            if (end > f->size) f->size = end;
+            f->modified = time(NULL);
+            _persist(f, false);
+            return (ssize_t)len;
+        }
+        if ((unpacked = _unpack(f)) < 0) return -1;
+    }
+    int zs = -1, runs = -1, swaps = -1;
+    if ((zs = _inflate(f, from, end)) < 0 || (runs = _map(f, off, end, true)) < 0 ||
+        (swaps = _unshare(f, from, end - from)) < 0) {
+        _persist(f, true);          /* blocos já mapeados continuam do arquivo */
         return -1;
     }
+    if (off > f->size) _zero(f, f->size, off - f->size);
+    _xfer(f, off, (void *)buf, len, 1);
+    if (end > f->size) f->size = end;
+    f->modified = time(NULL);
+    zs += _seal(f, from, end);
+    bool packed = _pack(f);
+    /* regravar o mapa (cadeia de extents) só se ele mudou */
+    _persist(f, swaps > 0 || runs > 0 || unpacked > 0 || packed || zs > 0);
+    return (ssize_t)len;
+}
 
-    size_t rem=f->size,pos=0; char buf[BLOCK_SIZE];
-    while (rem) {
-        size_t bi = pos / BLOCK_SIZE, bo = pos % BLOCK_SIZE;
-        size_t chunk = BLOCK_SIZE - bo; if (chunk > rem) chunk = rem;
-        int phys = GPOINTER_TO_INT(g_ptr_array_index(f->blocks,bi));
-        block_read(phys, buf, chunk, bo);
-        fwrite(buf,1,chunk,stdout);
-        pos += chunk; rem -= chunk;
+/* muda o tamanho lógico: encolher devolve na hora os blocos além do novo
+ * fim (tudo, se couber inline); crescer zera os bytes velhos que restarem
+ * nos blocos já mapeados (o resto fica sem blocos e é lido como zeros)  */
+static int _resize(FCB *f, size_t sz)
+{
+    size_t bs = block_size();
+    if (_inline(f)) {
+        if (sz <= FS_INLINE_MAX) {
+            if (sz < f->size) memset(f->inl + sz, 0, f->size - sz);
+            f->size = sz;
+            return 0;
+        }
+        if (_promote(f)) return -1;
+    }
+    if (sz < f->size && sz <= FS_INLINE_MAX) {
+        if (_demote(f, sz)) return -1;
+    } else if (_unpack(f) < 0) {
+        return -1;
+    } else if (sz < f->size) {
+        uint32_t keep = (uint32_t)((sz + bs - 1) / bs), end = ext_end(f->extents);
+        if (_inflate(f, sz - 1, sz) < 0) return -1;    /* vira o último bloco */
+        if (end > keep) ext_punch(f->extents, keep, end - keep, _release);
+    } else if (sz > f->size) {
+        size_t stale = MIN(sz, (size_t)ext_end(f->extents) * bs);
+        if (stale > f->size) {
+            if (_unshare(f, f->size, stale - f->size) < 0) return -1;
+            _zero(f, f->size, stale - f->size);
+        }
     }
-    if (f->size) putchar('\n');
-    f->accessed = time(NULL);
+    f->size = sz;
     return 0;
 }
 
+/* descreve [off, off+len) (limitado ao EOF) como trechos apontando direto
+ * para o block store: um iovec por faixa contígua, buracos apontam para
+ * _zeros. Um bloco comprimido sai sozinho, do buffer da thread (_zbuf).
+ * Retorna iovecs usados; *got = bytes cobertos                       */
+static int _iov(FCB *f, size_t off, size_t len, struct iovec *iov, int max, size_t *got)
+{
+    size_t bs = block_size(), done = 0;
+    int    n  = 0;
+    len = off < f->size ? MIN(len, f->size - off) : 0;
+    if (_inline(f) && len && max) {
+        iov[0].iov_base = f->inl + off;
+        iov[0].iov_len  = len;
+        *got = len;
+        return 1;
+    }
+    size_t at = _tail(f) ? _tail_at(f) : SIZE_MAX;
+    while (done < len && n < max) {
+        size_t   pos = off + done, bo = pos % bs;
+        uint32_t pb, run = ext_find(f->extents, (uint32_t)(pos / bs), &pb);
+        size_t   chunk = MIN(MIN((size_t)run * bs - bo, len - done), at - pos);
+        if (pos >= at) {                                   /* cauda */
+            chunk = len - done;
+            iov[n].iov_base = (void *)(_tail_ptr(f) + (pos - at));
+        } else if (pb == EXT_HOLE) {
+            chunk = MIN(chunk, sizeof _zeros);
+            iov[n].iov_base = (void *)_zeros;
+        } else if (_z(pb)) {                 /* um por chamada: o buffer é único */
+            uint8_t *zb = _zbuf();
+            if (n || !block_zread(pb, zb, bs, 0)) break;
+            chunk = MIN(chunk, bs - bo);
+            iov[n].iov_base = zb + bo;
+            max = 1;
+        } else {
+            iov[n].iov_base = (char *)block_data((int)pb, run) + bo;
+        }
+        iov[n++].iov_len = chunk;
+        done += chunk;
+    }
+    *got = done;
+    return n;
+}
+
+/* escreve [off, off+len) em `fd` com writev sobre os próprios blocos;
+ * -1 se um bloco comprimido não descomprime antes do fim do trecho   */
+static ssize_t _send(FCB *f, int fd, size_t off, size_t len)
+{
+    struct iovec iov[FS_IOV_BATCH];
+    size_t       total = 0, end = off < f->size ? MIN(len, f->size - off) : 0;
+    for (;;) {
+        size_t span;
+        int    n = _iov(f, off + total, len - total, iov, FS_IOV_BATCH, &span);
+        if (!n) return total < end ? -1 : (ssize_t)total;
+        for (int i = 0; i < n; ) {                    /* escrita parcial */
+            ssize_t w = writev(fd, iov + i, n - i);
+            if (w < 0) { if (errno == EINTR) continue; return total ? (ssize_t)total : -1; }
+            total += (size_t)w;
+            while (i < n && (size_t)w >= iov[i].iov_len) w -= (ssize_t)iov[i++].iov_len;
+            if (i < n) { iov[i].iov_base = (char *)iov[i].iov_base + w; iov[i].iov_len -= (size_t)w; }
+        }
+    }
+}
+
+/* com o FCB travado para leitura */
+static ssize_t _read_at(FCB *f, void *buf, size_t len, size_t off)
+{
+    if (off >= f->size) return 0;                          /* EOF */
+    len = MIN(len, f->size - off);
+    if (_inline(f)) { memcpy(buf, f->inl + off, len); return (ssize_t)len; }
+    return _xfer(f, off, buf, len, 0) == len ? (ssize_t)len : -1;  /* comprimido ruim */
+}
+
+/* atime depois da leitura: leitores não disputam a trava de escrita
+ * mais de uma vez por segundo (comparação sem trava, no pior caso o
+ * mesmo valor é gravado de novo)                                     */
+static void _accessed(FCB *f)
+{
+    time_t now = time(NULL);
+    if (f->accessed == now) return;
+    g_rw_lock_writer_lock(&f->lock);
+    f->accessed = now;
+    _persist(f, false);
+    g_rw_lock_writer_unlock(&f->lock);
+}
+
+/*──────────────────── criação vazia ───────────────────────*/
+/* devolve o FCB novo já fixado; NULL se o nome existe (ou sem W) */
+static FCB *_create(Dir *dir, const char *name)
+{
+    if (!_dir_if_perm(dir, P_WRITE))             return NULL;
+    if (!*name || strlen(name) > DIR_NAME_MAX)   return NULL;
+
+    FCB *f = NULL;
+    g_rw_lock_writer_lock(&dir->lock);
+    if (!g_hash_table_contains(dir->files, name) && (f = _new_fcb(dir, name))) {
+        g_hash_table_insert(dir->files, g_strdup(name), f);
+        _persist(f, false);
+        g_atomic_int_inc(&f->refs);
+    }
+    g_rw_lock_writer_unlock(&dir->lock);
+    return f;
+}
+
+static int _touch(Dir *base, const char *path)
+{
+    const char *name;
+    Dir *dir = _at(base, path, &name);
+    FCB *f   = dir ? _create(dir, name) : NULL;
+    _put(f);
+    return f ? 0 : -1;
+}
+
+/*──────────────────── escrita / append ─────────────────────*/
+static int _echo(Dir *base, const char *path, const char *txt, int append)
+{
+    const char *name;
+    Dir *dir = _at(base, path, &name);
+    if (!dir || !txt) return -1;
+    size_t len = strlen(txt);
+
+    FCB *f = _get(dir, name);                       /* cria se não existe */
+    if (!f && !(f = _create(dir, name)) && !(f = _get(dir, name))) return -1;
+
+    int rc = -1;
+    g_rw_lock_writer_lock(&f->lock);
+    if (!auth_has_perm(f, P_WRITE)) session_puts("Permissão negada");
+    else {
+        int shrunk = 0;
+        if (!append) {                          /* solta a cauda já */
+            shrunk = _resize(f, MIN(f->size, len));
+            _persist(f, true);        /* blocos soltos saem do mapa do volume */
+        }
+        if (!shrunk) rc = (int)_write_at(f, txt, len, append ? f->size : 0);
+    }
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+    return rc;
+}
+
+/*──────────────────── leitura (cat) ───────────────────────*/
+static FCB *_readable(Dir *base, const char *path);
+
+static int _cat(Dir *base, const char *path)
+{
+    FCB *f = _readable(base, path);
+    if (!f) return -1;
+
+    FILE *out = session_out();
+    int   rc  = 0;
+    g_rw_lock_reader_lock(&f->lock);
+    size_t n = f->size;
+    if (out == stdout && n >= FS_CAT_DIRECT) {  /* grande: direto via writev */
+        fflush(stdout);
+        if (_send(f, STDOUT_FILENO, 0, n) != (ssize_t)n) rc = -1;
+    } else {                        /* buffer do stdio ou da sessão     */
+        struct iovec iov[FS_IOV_BATCH];
+        for (size_t done = 0, span; done < n; done += span) {
+            int k = _iov(f, done, n - done, iov, FS_IOV_BATCH, &span);
+            if (!k) { rc = -1; break; }                   /* comprimido ruim */
+            for (int i = 0; i < k; ++i) fwrite(iov[i].iov_base, 1, iov[i].iov_len, out);
+        }
+    }
+    g_rw_lock_reader_unlock(&f->lock);
+    if (!rc) stats_bytes(ST_FS_CAT, n);
+    if (n && !rc) fputc('\n', out);
+    _accessed(f);
+    _put(f);
+    return rc;
+}
+
+/*──────────────────── E/S posicional ─────────────────────*/
+/* arquivo existente que o usuário pode ler (fixado, ou NULL) */
+static FCB *_readable(Dir *base, const char *path)
+{
+    const char *name;
+    Dir *dir = _dir_if_perm(_at(base, path, &name), P_READ|P_EXEC);
+    FCB *f   = _get(dir, name);
+    if (f && !_allowed(f, P_READ)) { _put(f); return NULL; }
+    return f;
+}
+
+/* arquivo existente que o usuário pode alterar (fixado, ou NULL) */
+static FCB *_writable(Dir *base, const char *path)
+{
+    const char *name;
+    Dir *dir = _dir_if_perm(_at(base, path, &name), P_EXEC);
+    FCB *f   = _get(dir, name);
+    if (f && !_allowed(f, P_WRITE)) { _put(f); return NULL; }
+    return f;
+}
+
+/* binário: não depende de '\0' nem de stdio; lê até EOF e escreve em
+ * qualquer deslocamento (estendendo o arquivo se preciso)          */
+static ssize_t _pread(Dir *base, const char *name, void *buf, size_t len, size_t off)
+{
+    if (!buf && len) return -1;
+    FCB *f = _readable(base, name);
+    if (!f) return -1;
+    g_rw_lock_reader_lock(&f->lock);
+    ssize_t n = _read_at(f, buf, len, off);
+    g_rw_lock_reader_unlock(&f->lock);
+    _accessed(f);
+    _put(f);
+    return n;
+}
+
+/*──────────────────── leitura sem cópia ───────────────────*/
+static int _read_iov(Dir *base, const char *name, size_t off, size_t len,
+                     struct iovec *iov, int iovcnt, size_t *nbytes)
+{
+    if (!iov || iovcnt <= 0) return -1;
+    FCB   *f = _readable(base, name);
+    size_t got;
+    if (!f) return -1;
+    g_rw_lock_reader_lock(&f->lock);
+    int n = _iov(f, off, len, iov, iovcnt, &got);
+    if (!n && len && off < f->size) n = -1;          /* comprimido ruim */
+    g_rw_lock_reader_unlock(&f->lock);
+    if (nbytes) *nbytes = got;
+    stats_bytes(ST_FS_READ_IOV, got);
+    _accessed(f);
+    _put(f);
+    return n;
+}
+
+static ssize_t _sendfile(Dir *base, int fd, const char *name, size_t off, size_t len)
+{
+    FCB *f = _readable(base, name);
+    if (!f) return -1;
+    g_rw_lock_reader_lock(&f->lock);
+    ssize_t n = _send(f, fd, off, len);
+    g_rw_lock_reader_unlock(&f->lock);
+    _accessed(f);
+    _put(f);
+    return n;
+}
+
+static ssize_t _pwrite(Dir *base, const char *name, const void *buf, size_t len, size_t off)
+{
+    if (!buf && len) return -1;
+    FCB *f = _writable(base, name);
+    if (!f) return -1;
+    g_rw_lock_writer_lock(&f->lock);
+    ssize_t n = _write_at(f, buf, len, off);
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+    return n;
+}
+
+/*──────────────────── truncate / fallocate ───────────────*/
+static int _truncate(Dir *base, const char *name, size_t size)
+{
+    FCB *f = _writable(base, name);
+    if (!f) return -1;
+    g_rw_lock_writer_lock(&f->lock);
+    size_t old = f->size;
+    int    rc  = _resize(f, size);
+    if (!rc) { _seal(f, old, size); _pack(f); }
+    f->modified = time(NULL);
+    _persist(f, true);
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+    return rc;
+}
+
+/* reserva os buracos de [off, off+len) de uma vez, em faixas tão
+ * contíguas quanto o bitmap permitir; o tamanho cresce até off+len
+ * (como posix_fallocate) e o trecho novo é zerado                     */
+static int _fallocate(Dir *base, const char *name, size_t off, size_t len)
+{
+    if (off + len < off) return -1;
+    FCB *f = _writable(base, name);
+    if (!f) return -1;
+    g_rw_lock_writer_lock(&f->lock);
+    int rc = 0;
+    if (!_inline(f) || off + len > FS_INLINE_MAX)
+        rc = (_inline(f) && _promote(f)) || _unpack(f) < 0 ||
+             _map(f, off, off + len, false) < 0 ? -1 : 0;
+    if (!rc && off + len > f->size) rc = _resize(f, off + len);
+    f->modified = time(NULL);
+    _persist(f, true);
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+    return rc;
+}
+
 /*──────────────────── remoção ─────────────────────────────*/
-int fs_rm(const char *name)
+static int _rm(Dir *base, const char *path)
 {
-    Dir *cwd = _cwd_if_perm(P_WRITE);
-    if (!cwd) return -1;
-    return g_hash_table_remove(cwd->files,name) ? 0 : -1;
+    const char *name;
+    Dir *dir = _dir_if_perm(_at(base, path, &name), P_WRITE);
+    if (!dir) return -1;
+    g_rw_lock_writer_lock(&dir->lock);
+    gboolean ok = g_hash_table_remove(dir->files,name);   /* → fs_fcb_release */
+    g_rw_lock_writer_unlock(&dir->lock);
+    return ok ? 0 : -1;
 }
 
 /*──────────────────── cópia --------------------------------*/
-int fs_cp(const char *src, const char *dst)
+static int _cp(Dir *base, const char *src, const char *dst)
 {
-    Dir *cwd = _cwd_if_perm(P_WRITE);
-    if (!cwd) return -1;
-    if (_lookup(dst)) return -1;
-    FCB *orig = _lookup(src); if (!orig) return -1;
-    if (!auth_has_perm(orig,P_READ)) { puts("Permissão negada"); return -1; }
-
-    if (fs_touch(dst)) return -1;
-    FCB *copy = _lookup(dst);
+    FCB *orig = _readable(base, src); if (!orig) return -1;
+    const char *name;
+    Dir *dir  = _at(base, dst, &name);
+    FCB *copy = dir ? _create(dir, name) : NULL;
+    if (!copy) { _put(orig); return -1; }
 
+    /* origem para leitura, depois a cópia (recém-criada) para escrita */
+    g_rw_lock_reader_lock(&orig->lock);
+    g_rw_lock_writer_lock(&copy->lock);
     copy->size  = orig->size;
     copy->type  = orig->type;
     copy->perms = orig->perms;
     copy->owner = auth_uid();
     copy->group = auth_gid();
 
-    for (guint i=0;i<orig->blocks->len;++i) {
-        int nb = block_alloc(); if (nb < 0) return -1;
-        int ob = GPOINTER_TO_INT(g_ptr_array_index(orig->blocks,i));
-        char buf[BLOCK_SIZE];
-        block_read(ob,buf,BLOCK_SIZE,0);
-        block_write(nb,buf,BLOCK_SIZE,0);
-        g_ptr_array_add(copy->blocks,GINT_TO_POINTER(nb));
+    /* copy-on-write: compartilha os extents (O(nº de extents)); cada
+       bloco só é duplicado na primeira escrita (_unshare). Inline é
+       só copiar os bytes                                               */
+    int rc = 0;
+    copy->zip = orig->zip;
+    if (_inline(orig)) memcpy(copy->inl, orig->inl, sizeof copy->inl);
+    else copy->extents = ext_new();
+    for (guint i=0;copy->extents && !rc && i<orig->extents->len;++i) {
+        Extent e = g_array_index(orig->extents,Extent,i);
+        if (!_z(e.pblk)) {
+            block_ref_range((int)e.pblk,e.len);
+            g_array_append_val(copy->extents,e);
+        } else for (uint32_t k = 0; !rc && k < e.len; ++k) {   /* nem comprimidos */
+            uint32_t pb = _zcopy(e.pblk + k);
+            if (pb != EXT_HOLE) ext_insert(copy->extents, e.lblk + k, pb, 1);
+            else                rc = -1;
+        }
+    }
+    if (rc) _resize(copy, 0);                  /* sem espaço: cópia vazia */
+    else if (_tail(orig)) {                      /* o fragmento não se compartilha */
+        size_t at = _tail_at(orig);
+        copy->size = at;
+        if (_write_at(copy, _tail_ptr(orig), orig->size - at, at) < 0) rc = -1;
     }
     copy->created = copy->modified = time(NULL);
-    return 0;
+    stats_bytes(ST_FS_CP, copy->size);
+    _persist(copy, true);
+    g_rw_lock_writer_unlock(&copy->lock);
+    g_rw_lock_reader_unlock(&orig->lock);
+    _put(copy); _put(orig);
+    return rc;
 }
 
 /*──────────────────── rename / move ───────────────────────*/
-int fs_mv(const char *src, const char *dst)
+/* também entre diretórios: W nos dois; as duas pastas são travadas em
+ * ordem de endereço (sem deadlock entre mv cruzados), depois o FCB    */
+static int _mv(Dir *base, const char *src, const char *dst)
 {
-    Dir *cwd = _cwd_if_perm(P_WRITE);
-    if (!cwd || _lookup(dst)) return -1;
-    gpointer v = g_hash_table_lookup(cwd->files, src);
-    if (!v) return -1;
+    const char *sn, *dn;
+    Dir *sd = _dir_if_perm(_at(base, src, &sn), P_WRITE);
+    Dir *dd = sd ? _dir_if_perm(_at(base, dst, &dn), P_WRITE) : NULL;
+    if (!dd || !*dn || strlen(dn) > DIR_NAME_MAX) return -1;
 
-    g_hash_table_steal(cwd->files, src);
-    ((FCB*)v)->name = g_strdup(dst);
-    g_hash_table_insert(cwd->files, g_strdup(dst), v);
-    return 0;
+    Dir *lo = sd < dd ? sd : dd, *hi = sd < dd ? dd : sd;
+    g_rw_lock_writer_lock(&lo->lock);
+    if (hi != lo) g_rw_lock_writer_lock(&hi->lock);
+
+    FCB *f = g_hash_table_contains(dd->files, dn) ? NULL
+           : g_hash_table_lookup(sd->files, sn);
+    if (f) {
+        g_hash_table_steal(sd->files, sn);
+        g_rw_lock_writer_lock(&f->lock);
+        g_free(f->name);
+        f->name = g_strdup(dn);
+        f->dir  = dd;
+        _persist(f, false);
+        g_rw_lock_writer_unlock(&f->lock);
+        g_hash_table_insert(dd->files, g_strdup(dn), f);
+    }
+    if (hi != lo) g_rw_lock_writer_unlock(&hi->lock);
+    g_rw_lock_writer_unlock(&lo->lock);
+    return f ? 0 : -1;
 }
 
 /*──────────────────── chmod (restrito) ────────────────────*/
-int fs_chmod(const char *name, uint16_t mode)
+static int _chmod_locked(FCB *f, uint16_t mode);
+
+static int _chmod(Dir *base, const char *path, uint16_t mode)
+{
+    const char *name;
+    Dir *dir = _dir_if_perm(_at(base, path, &name), P_EXEC);
+    FCB *f   = _get(dir, name);
+    if (!f) return -1;
+    g_rw_lock_writer_lock(&f->lock);
+    int rc = _chmod_locked(f, mode);
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+    return rc;
+}
+
+static int _chmod_locked(FCB *f, uint16_t mode)
 {
-    FCB *f = _lookup(name); if (!f) return -1;
     uint16_t desired = mode & 0777;
     uint16_t old     = f->perms;
 
     /* root pode tudo ------------------------------------------------*/
-    if (auth_uid() == 0) { f->perms = desired; return 0; }
+    if (auth_uid() == 0) { f->perms = desired; _persist(f, false); return 0; }
 
     /* somente o dono pode (além do root) ---------------------------*/
     if (auth_uid() != f->owner) {
-        puts("chmod: apenas o dono ou root");
+        session_puts("chmod: apenas o dono ou root");
         return -1;
     }
 
@@ -221,5 +1006,235 @@ int fs_chmod(const char *name, uint16_t mode)
     new_pub   &=  (old       & 7);
 
     f->perms = new_owner | (new_group << 3) | new_pub;
+    _persist(f, false);
     return 0;
 }
+
+/*──────────────────── compressão ─────────────────────────*/
+static int _compress(Dir *base, const char *name, bool on)
+{
+    FCB *f = _writable(base, name);
+    if (!f) return -1;
+    g_rw_lock_writer_lock(&f->lock);
+    f->zip = on;
+    int n = _inline(f) ? 0 : on ? _seal(f, 0, f->size) : _inflate(f, 0, f->size);
+    _persist(f, n != 0);
+    g_rw_lock_writer_unlock(&f->lock);
+    _put(f);
+    return n < 0 ? -1 : 0;
+}
+
+/*──────────────────── tabela de arquivos abertos ─────────*/
+/* o handle guarda o FCB e o modo já autorizado: fs_read/fs_write não
+ * refazem busca por nome nem avaliação de ACL                       */
+typedef struct {
+    FCB   *f;                      /* fixado enquanto o handle vive */
+    int    flags;                  /* FS_O_*                        */
+    size_t off;                    /* posição corrente (sob pos)    */
+    GMutex pos;                    /* ops no mesmo handle em série  */
+    gint   refs;                   /* tabela + ops em curso         */
+} OpenFile;
+
+static GPtrArray *_oft;            /* <OpenFile*>, índice = handle */
+static GArray    *_oft_free;       /* <int> slots livres (pilha)   */
+static GMutex     _oft_lock;
+
+/* fixa o handle (um fs_close concorrente não o libera no meio da op) */
+static OpenFile *_handle(int fd, int need)
+{
+    OpenFile *o = NULL;
+    g_mutex_lock(&_oft_lock);
+    if (_oft && fd >= 0 && (guint)fd < _oft->len) {
+        o = g_ptr_array_index(_oft, fd);
+        if (o && (o->flags & need) == need) g_atomic_int_inc(&o->refs);
+        else o = NULL;
+    }
+    g_mutex_unlock(&_oft_lock);
+    return o;
+}
+
+static void _unhandle(OpenFile *o)
+{
+    if (!g_atomic_int_dec_and_test(&o->refs)) return;
+    _put(o->f);
+    g_mutex_clear(&o->pos);
+    g_free(o);
+}
+
+static int _open(Dir *base, const char *path, int flags)
+{
+    if (!(flags & FS_O_RDWR)) return -1;                 /* nem R nem W */
+    FCB *f;
+    if (flags & FS_O_WRONLY) {                 /* uma resolução: dir serve aos dois */
+        const char *name;
+        Dir *dir = _at(base, path, &name);
+        f = _get(_dir_if_perm(dir, P_EXEC), name);
+        if (f && !_allowed(f, P_WRITE)) {
+            _put(f);
+            f = NULL;
+        } else if (!f && dir && (flags & FS_O_CREAT)) {
+            f = _create(dir, name);                   /* NULL se o nome existe */
+        }
+        if (f && (flags & FS_O_RDONLY) && !_allowed(f, P_READ)) {
+            _put(f);
+            f = NULL;
+        }
+    } else {
+        f = _readable(base, path);
+    }
+    if (!f) return -1;
+    if ((flags & FS_O_TRUNC) && (flags & FS_O_WRONLY)) {
+        g_rw_lock_writer_lock(&f->lock);
+        if (f->size) {
+            _resize(f, 0);
+            f->modified = time(NULL);
+            _persist(f, true);
+        }
+        g_rw_lock_writer_unlock(&f->lock);
+    }
+
+    OpenFile *o = g_new0(OpenFile, 1);
+    o->f = f; o->flags = flags; o->refs = 1;          /* herda a fixação */
+    g_mutex_init(&o->pos);
+
+    g_mutex_lock(&_oft_lock);
+    if (!_oft) {
+        _oft      = g_ptr_array_new();
+        _oft_free = g_array_new(FALSE, FALSE, sizeof(int));
+    }
+    int fd;
+    if (_oft_free->len) {
+        fd = g_array_index(_oft_free, int, _oft_free->len - 1);
+        g_array_set_size(_oft_free, _oft_free->len - 1);
+        g_ptr_array_index(_oft, fd) = o;
+    } else {
+        fd = (int)_oft->len;
+        g_ptr_array_add(_oft, o);
+    }
+    g_mutex_unlock(&_oft_lock);
+    return fd;
+}
+
+/* o FCB removido antes só é liberado quando cai a última referência */
+static int _close(int fd)
+{
+    OpenFile *o = NULL;
+    g_mutex_lock(&_oft_lock);
+    if (_oft && fd >= 0 && (guint)fd < _oft->len && (o = g_ptr_array_index(_oft, fd))) {
+        g_ptr_array_index(_oft, fd) = NULL;
+        g_array_append_val(_oft_free, fd);
+    }
+    g_mutex_unlock(&_oft_lock);
+    if (!o) return -1;
+    _unhandle(o);
+    return 0;
+}
+
+static ssize_t _read(int fd, void *buf, size_t len)
+{
+    if (!buf && len) return -1;
+    OpenFile *o = _handle(fd, FS_O_RDONLY);
+    if (!o) return -1;
+    g_mutex_lock(&o->pos);
+    g_rw_lock_reader_lock(&o->f->lock);
+    ssize_t n = _read_at(o->f, buf, len, o->off);
+    g_rw_lock_reader_unlock(&o->f->lock);
+    if (n > 0) o->off += (size_t)n;
+    g_mutex_unlock(&o->pos);
+    _accessed(o->f);
+    _unhandle(o);
+    return n;
+}
+
+static ssize_t _write(int fd, const void *buf, size_t len)
+{
+    if (!buf && len) return -1;
+    OpenFile *o = _handle(fd, FS_O_WRONLY);
+    if (!o) return -1;
+    g_mutex_lock(&o->pos);
+    g_rw_lock_writer_lock(&o->f->lock);
+    if (o->flags & FS_O_APPEND) o->off = o->f->size;
+    ssize_t n = _write_at(o->f, buf, len, o->off);
+    g_rw_lock_writer_unlock(&o->f->lock);
+    if (n > 0) o->off += (size_t)n;
+    g_mutex_unlock(&o->pos);
+    _unhandle(o);
+    return n;
+}
+
+off_t fs_seek(int fd, off_t off, int whence)
+{
+    OpenFile *o = _handle(fd, 0);
+    if (!o) return -1;
+    g_mutex_lock(&o->pos);
+    off_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? (off_t)o->off : -1;
+    if (whence == SEEK_END) {
+        g_rw_lock_reader_lock(&o->f->lock);
+        base = (off_t)o->f->size;
+        g_rw_lock_reader_unlock(&o->f->lock);
+    }
+    off_t r = base < 0 || base + off < 0 ? -1 : (off_t)(o->off = (size_t)(base + off));
+    g_mutex_unlock(&o->pos);
+    _unhandle(o);
+    return r;
+}
+
+/*──────────────────── transações ─────────────────────────*/
+/* cada operação pública é uma transação do journal (aninhável), medida
+ * em stats e, com o tracer ligado, registrada com a chave k (hash do
+ * caminho ou fd); FS_TXN_IO também conta o retorno positivo como bytes */
+#define FS_TXN(op, k, call) do { uint64_t _t0 = stats_now(); jnl_begin();         \
+        __typeof__(call) _rc; TRACE_CALL(_rc, ST_##op, k, 0, 0, call); jnl_end(); \
+        stats_done(ST_##op, _t0, _rc); return _rc; } while (0)
+#define FS_TXN_IO(op, k, call) do { uint64_t _t0 = stats_now(); jnl_begin();      \
+        __typeof__(call) _rc; TRACE_CALL(_rc, ST_##op, k, 0, 0, call); jnl_end(); \
+        if (_rc > 0) stats_bytes(ST_##op, (uint64_t)_rc);                         \
+        stats_done(ST_##op, _t0, _rc); return _rc; } while (0)
+#define PH(p) trace_hash(p)
+
+int fs_touch_at(Dir *d, const char *p)                { FS_TXN(FS_TOUCH, PH(p), _touch(d, p)); }
+int fs_echo_at (Dir *d, const char *p, const char *t, int app)
+{ FS_TXN_IO(FS_ECHO, PH(p), _echo(d, p, t, app)); }
+int fs_cat_at  (Dir *d, const char *p)                { FS_TXN(FS_CAT, PH(p), _cat(d, p)); }
+ssize_t fs_pread_at (Dir *d, const char *p, void *buf, size_t len, size_t off)
+{ FS_TXN_IO(FS_PREAD, PH(p), _pread(d, p, buf, len, off)); }
+ssize_t fs_pwrite_at(Dir *d, const char *p, const void *buf, size_t len, size_t off)
+{ FS_TXN_IO(FS_PWRITE, PH(p), _pwrite(d, p, buf, len, off)); }
+int fs_read_iov_at(Dir *d, const char *p, size_t off, size_t len,
+                   struct iovec *iov, int iovcnt, size_t *nbytes)
+{ FS_TXN(FS_READ_IOV, PH(p), _read_iov(d, p, off, len, iov, iovcnt, nbytes)); }
+ssize_t fs_sendfile_at(Dir *d, int fd, const char *p, size_t off, size_t len)
+{ FS_TXN_IO(FS_SENDFILE, PH(p), _sendfile(d, fd, p, off, len)); }
+int fs_truncate_at (Dir *d, const char *p, size_t size)           { FS_TXN(FS_TRUNCATE, PH(p), _truncate(d, p, size)); }
+int fs_fallocate_at(Dir *d, const char *p, size_t off, size_t len) { FS_TXN(FS_FALLOCATE, PH(p), _fallocate(d, p, off, len)); }
+int fs_rm_at   (Dir *d, const char *p)                    { FS_TXN(FS_RM, PH(p), _rm(d, p)); }
+int fs_cp_at   (Dir *d, const char *src, const char *dst) { FS_TXN(FS_CP, PH(src), _cp(d, src, dst)); }
+int fs_mv_at   (Dir *d, const char *src, const char *dst) { FS_TXN(FS_MV, PH(src), _mv(d, src, dst)); }
+int fs_chmod_at(Dir *d, const char *p, uint16_t mode)     { FS_TXN(FS_CHMOD, PH(p), _chmod(d, p, mode)); }
+int fs_compress_at(Dir *d, const char *p, bool on)        { FS_TXN(FS_COMPRESS, PH(p), _compress(d, p, on)); }
+int fs_open_at (Dir *d, const char *p, int flags)         { FS_TXN(FS_OPEN, PH(p), _open(d, p, flags)); }
+int fs_close(int fd)                                      { FS_TXN(FS_CLOSE, (uint32_t)fd, _close(fd)); }
+ssize_t fs_read (int fd, void *buf, size_t len)           { FS_TXN_IO(FS_READ, (uint32_t)fd, _read(fd, buf, len)); }
+ssize_t fs_write(int fd, const void *buf, size_t len)     { FS_TXN_IO(FS_WRITE, (uint32_t)fd, _write(fd, buf, len)); }
+
+/* relativos ao cwd ---------------------------------------------------- */
+int fs_touch(const char *p)                         { return fs_touch_at(NULL, p); }
+int fs_echo (const char *p, const char *t, int app) { return fs_echo_at(NULL, p, t, app); }
+int fs_cat  (const char *p)                         { return fs_cat_at(NULL, p); }
+ssize_t fs_pread (const char *p, void *buf, size_t len, size_t off)
+{ return fs_pread_at(NULL, p, buf, len, off); }
+ssize_t fs_pwrite(const char *p, const void *buf, size_t len, size_t off)
+{ return fs_pwrite_at(NULL, p, buf, len, off); }
+int fs_read_iov(const char *p, size_t off, size_t len,
+                struct iovec *iov, int iovcnt, size_t *nbytes)
+{ return fs_read_iov_at(NULL, p, off, len, iov, iovcnt, nbytes); }
+ssize_t fs_sendfile(int fd, const char *p, size_t off, size_t len)
+{ return fs_sendfile_at(NULL, fd, p, off, len); }
+int fs_truncate (const char *p, size_t size)            { return fs_truncate_at(NULL, p, size); }
+int fs_fallocate(const char *p, size_t off, size_t len) { return fs_fallocate_at(NULL, p, off, len); }
+int fs_rm   (const char *p)                     { return fs_rm_at(NULL, p); }
+int fs_cp   (const char *src, const char *dst)  { return fs_cp_at(NULL, src, dst); }
+int fs_mv   (const char *src, const char *dst)  { return fs_mv_at(NULL, src, dst); }
+int fs_chmod(const char *p, uint16_t mode)      { return fs_chmod_at(NULL, p, mode); }
+int fs_compress(const char *p, bool on)         { return fs_compress_at(NULL, p, on); }
+int fs_open (const char *p, int flags)          { return fs_open_at(NULL, p, flags); }
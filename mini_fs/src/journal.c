@@ -0,0 +1,332 @@
+#include "journal.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>      /* open                       */
+#include <unistd.h>     /* pread, pwrite, fdatasync   */
+#include <sys/stat.h>
+
+#define JNL_MAGIC  0x314C4E4Au                 /* "JNL1" */
+
+/*  formato: [JnlGroup][JnlRec][dados]...[JnlRec][dados] por lote -------- */
+typedef struct {
+    uint32_t magic;
+    uint32_t nrec;
+    uint64_t seq;                  /* consecutivo; quebra = fim do diário */
+    uint64_t bytes;                /* registros que seguem o cabeçalho    */
+    uint64_t csum;                 /* FNV-1a 64 dos registros             */
+} JnlGroup;
+
+typedef struct {
+    uint64_t off;                  /* posição na imagem                   */
+    uint32_t len;
+    uint32_t _pad;
+} JnlRec;
+
+/*──────────────── estado ──────────────────────────────────*/
+static int       _jfd = -1, _ifd = -1;
+static uint8_t  *_meta;            /* região privada de metadados         */
+static size_t    _meta_len;
+static uint8_t  *_dirty;           /* 1 bit por linha de JNL_LINE bytes   */
+static GArray   *_lines;           /* <uint32_t> linhas sujas do lote     */
+static unsigned  _ntx;             /* transações fechadas no lote         */
+static gint64    _t0;              /* início do lote (µs)                 */
+static uint64_t  _seq = 1;
+static uint64_t  _jsize;           /* bytes já no diário                  */
+static bool      _img_bad;         /* pwrite na imagem falhou: o diário
+                                      é reaplicado antes de ser truncado */
+
+static int  (*_pre_commit)(void);
+static void (*_on_commit)(void);
+
+/*  Várias threads: cada uma aninha as próprias transações; o lote é    *
+ *  gravado só com todas fora de transação (_active == 0). Quem fecha   *
+ *  o lote ergue _flushing, que segura novos jnl_begin até o fim.       */
+static _Thread_local int _depth;   /* aninhamento de jnl_begin (thread)   */
+static int       _active;          /* threads dentro de uma transação     */
+static bool      _flushing;        /* lote sendo gravado                  */
+static GMutex    _jm;              /* estado acima + _dirty/_lines/_ntx   */
+static GCond     _jc;
+
+/*──────────────── helpers ─────────────────────────────────*/
+static uint64_t _fnv64(uint64_t h, const void *p, size_t n)
+{
+    const uint8_t *b = p;
+    for (size_t i = 0; i < n; ++i) h = (h ^ b[i]) * 1099511628211ull;
+    return h;
+}
+#define FNV64_INIT 14695981039346656037ull
+
+static gint _cmp_u32(gconstpointer a, gconstpointer b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int _write_all(int fd, const void *buf, size_t n, uint64_t off)
+{
+    const uint8_t *p = buf;
+    while (n) {
+        ssize_t w = pwrite(fd, p, n, (off_t)off);
+        if (w <= 0) return -1;
+        p += w; n -= (size_t)w; off += (uint64_t)w;
+    }
+    return 0;
+}
+
+/*──────────────── replay (antes do mmap) ──────────────────*/
+/* reaplica na imagem os lotes íntegros e consecutivos de `fd`; devolve
+ * quantos, ou -1 se uma escrita na imagem falhou. *last = último seq   */
+static int _apply(int fd, int img_fd, uint64_t *last)
+{
+    struct stat st;
+    if (fstat(img_fd, &st)) return -1;
+
+    uint64_t pos = 0;
+    int      applied = 0;
+    JnlGroup g;
+    *last = 0;
+    while (pread(fd, &g, sizeof g, (off_t)pos) == (ssize_t)sizeof g &&
+           g.magic == JNL_MAGIC && (!*last || g.seq == *last + 1)) {
+        uint8_t *buf = g_try_malloc(g.bytes ? g.bytes : 1);
+        if (!buf) break;
+        if (pread(fd, buf, g.bytes, (off_t)(pos + sizeof g)) != (ssize_t)g.bytes ||
+            _fnv64(FNV64_INIT, buf, g.bytes) != g.csum) {
+            g_free(buf); break;                        /* lote incompleto */
+        }
+        for (size_t o = 0, i = 0; i < g.nrec; ++i) {
+            JnlRec *r = (JnlRec *)(buf + o);
+            if (r->off + r->len > (uint64_t)st.st_size) break;
+            if (_write_all(img_fd, r + 1, r->len, r->off)) { g_free(buf); return -1; }
+            o += sizeof *r + r->len;
+        }
+        g_free(buf);
+        *last = g.seq; pos += sizeof g + g.bytes; ++applied;
+    }
+    return applied;
+}
+
+/* o diário só é esvaziado depois que a imagem recebeu e sincronizou
+ * tudo: numa falha ele fica para a próxima montagem                  */
+int jnl_replay(const char *path, int img_fd)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { perror(path); return -1; }
+
+    uint64_t last;
+    int      applied = _apply(fd, img_fd, &last);
+    if (applied < 0 || (applied && fsync(img_fd))) {
+        perror("journal: replay");
+        close(fd);
+        return -1;
+    }
+    if (applied) {
+        fprintf(stderr, "journal: %d lote(s) reaplicado(s)\n", applied);
+        _seq = last + 1;
+    }
+    int rc = ftruncate(fd, 0) || fsync(fd) ? -1 : applied;
+    close(fd);
+    return rc;
+}
+
+/*──────────────── abertura / fechamento ───────────────────*/
+int jnl_open(const char *path, int img_fd, uint8_t *meta, size_t meta_len)
+{
+    _jfd = open(path, O_RDWR | O_CREAT, 0644);
+    if (_jfd < 0) { perror(path); return -1; }
+
+    size_t nlines = (meta_len + JNL_LINE - 1) / JNL_LINE;
+    _dirty    = calloc((nlines + 7) / 8, 1);
+    _lines    = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    _ifd      = img_fd;
+    _meta     = meta;
+    _meta_len = meta_len;
+    _jsize    = 0;
+    _img_bad  = false;
+    _depth    = 0;
+    _active   = 0;
+    _flushing = false;
+    _ntx      = 0;
+    return _dirty ? 0 : -1;
+}
+
+void jnl_close(void)
+{
+    if (!_meta) return;
+    jnl_checkpoint();
+    close(_jfd);
+    free(_dirty);
+    g_array_free(_lines, TRUE);
+    _meta = NULL; _dirty = NULL; _lines = NULL; _jfd = _ifd = -1;
+}
+
+bool jnl_active(void) { return _meta != NULL; }
+
+void jnl_set_commit_hooks(int (*pre)(void), void (*post)(void))
+{
+    _pre_commit = pre;
+    _on_commit  = post;
+}
+
+/*──────────────── barreira de gravação ────────────────────*/
+/* com _jm: torna-se o gravador e espera as transações abertas fecharem */
+static void _quiesce_locked(void)
+{
+    _flushing = true;
+    while (_active) g_cond_wait(&_jc, &_jm);
+}
+
+static void _resume(void)
+{
+    g_mutex_lock(&_jm);
+    _flushing = false;
+    g_cond_broadcast(&_jc);
+    g_mutex_unlock(&_jm);
+}
+
+/*──────────────── transações ──────────────────────────────*/
+/* jnl_begin pode esperar um lote em gravação: chamar antes de travar
+ * pastas/arquivos, nunca com uma trava que outra transação espera    */
+void jnl_begin(void)
+{
+    if (!_meta || _depth++) return;
+    g_mutex_lock(&_jm);
+    while (_flushing) g_cond_wait(&_jc, &_jm);
+    if (!_active++ && !_ntx && !_lines->len) _t0 = g_get_monotonic_time();
+    g_mutex_unlock(&_jm);
+}
+
+void jnl_log(const void *p, size_t n)
+{
+    if (!_meta || !n) return;
+    const uint8_t *b = p;
+    if (b < _meta || b + n > _meta + _meta_len) return;   /* fora da região */
+
+    size_t first = (size_t)(b - _meta) / JNL_LINE;
+    size_t last  = (size_t)(b - _meta + n - 1) / JNL_LINE;
+    g_mutex_lock(&_jm);
+    for (size_t l = first; l <= last; ++l) {
+        if (_dirty[l / 8] & (1u << (l % 8))) continue;
+        _dirty[l / 8] |= (uint8_t)(1u << (l % 8));
+        uint32_t v = (uint32_t)l;
+        g_array_append_val(_lines, v);
+    }
+    g_mutex_unlock(&_jm);
+}
+
+static int _flush(void);
+static int _checkpoint(void);
+
+void jnl_end(void)
+{
+    if (!_meta || !_depth || --_depth) return;
+    g_mutex_lock(&_jm);
+    ++_ntx;
+    bool due = !_flushing &&             /* se já há gravador, ele leva isto */
+               (_ntx >= JNL_GROUP_TXNS ||
+                (size_t)_lines->len * JNL_LINE >= JNL_GROUP_BYTES ||
+                g_get_monotonic_time() - _t0 >= JNL_GROUP_USEC);
+    if (!--_active) g_cond_broadcast(&_jc);           /* acorda o gravador */
+    if (!due) { g_mutex_unlock(&_jm); return; }
+    _quiesce_locked();
+    g_mutex_unlock(&_jm);
+
+    if (_flush() == 0 && _jsize > JNL_MAX_BYTES) _checkpoint();
+    _resume();
+}
+
+/*──────────────── group commit ────────────────────────────*/
+/* o lote é montado a partir do estado atual da região: sem transações
+ * abertas ele reflete exatamente as transações já fechadas           */
+int jnl_flush(void)
+{
+    if (!_meta || _depth) return 0;
+    g_mutex_lock(&_jm);
+    while (_flushing) g_cond_wait(&_jc, &_jm);
+    _quiesce_locked();
+    g_mutex_unlock(&_jm);
+    int rc = _flush();
+    _resume();
+    return rc;
+}
+
+/* só o gravador (barreira erguida) chega aqui */
+static int _flush(void)
+{
+    if (!_lines->len) { _ntx = 0; return 0; }
+
+    if (_pre_commit && _pre_commit()) { perror("journal"); return -1; }
+    g_array_sort(_lines, _cmp_u32);
+
+    /* agrupa linhas consecutivas em registros ------------------------ */
+    GByteArray *out = g_byte_array_new();
+    JnlGroup g = { JNL_MAGIC, 0, _seq, 0, 0 };
+    g_byte_array_append(out, (const guint8 *)&g, sizeof g);
+    for (guint i = 0; i < _lines->len; ) {
+        uint32_t a = g_array_index(_lines, uint32_t, i), b = a;
+        while (++i < _lines->len && g_array_index(_lines, uint32_t, i) == b + 1) ++b;
+        JnlRec r = { (uint64_t)a * JNL_LINE, 0, 0 };
+        r.len = (uint32_t)(MIN((uint64_t)(b + 1) * JNL_LINE, _meta_len) - r.off);
+        g_byte_array_append(out, (const guint8 *)&r, sizeof r);
+        g_byte_array_append(out, _meta + r.off, r.len);
+        ++g.nrec;
+    }
+    g.bytes = out->len - sizeof g;
+    g.csum  = _fnv64(FNV64_INIT, out->data + sizeof g, g.bytes);
+    memcpy(out->data, &g, sizeof g);
+
+    if (_write_all(_jfd, out->data, out->len, _jsize) || fdatasync(_jfd)) {
+        perror("journal");
+        g_byte_array_free(out, TRUE);
+        return -1;
+    }
+
+    /* lote durável: agora pode ir para a imagem (page cache) --------- */
+    for (size_t o = sizeof g; o < out->len; ) {
+        JnlRec *r = (JnlRec *)(out->data + o);
+        if (_write_all(_ifd, r + 1, r->len, r->off)) _img_bad = true;
+        o += sizeof *r + r->len;
+    }
+    _jsize += out->len;
+    ++_seq;
+    g_byte_array_free(out, TRUE);
+
+    g_mutex_lock(&_jm);
+    for (guint i = 0; i < _lines->len; ++i) {
+        uint32_t l = g_array_index(_lines, uint32_t, i);
+        _dirty[l / 8] &= (uint8_t)~(1u << (l % 8));
+    }
+    g_array_set_size(_lines, 0);
+    _ntx = 0;
+    g_mutex_unlock(&_jm);
+
+    if (_on_commit) _on_commit();              /* ex.: blocos adiados */
+    if (_lines->len) _t0 = g_get_monotonic_time();
+    return 0;
+}
+
+int jnl_checkpoint(void)
+{
+    if (!_meta || _depth) return 0;
+    g_mutex_lock(&_jm);
+    while (_flushing) g_cond_wait(&_jc, &_jm);
+    _quiesce_locked();
+    g_mutex_unlock(&_jm);
+    int rc = _checkpoint();
+    _resume();
+    return rc;
+}
+
+static int _checkpoint(void)
+{
+    if (_flush()) return -1;
+    if (_lines->len && _flush()) return -1;        /* o que o hook sujou */
+    uint64_t last;
+    if (_img_bad && _apply(_jfd, _ifd, &last) < 0) return -1;
+    if (fsync(_ifd)) return -1;
+    _img_bad = false;
+    if (ftruncate(_jfd, 0) || fdatasync(_jfd)) return -1;
+    _jsize = 0;
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_MAX_DIST  65535u            /* distância cabe em 16 bits      */
+#define LZ_SKIP_LOG  6                 /* sem match: passo cresce a cada 64 */
+
+static inline uint32_t _rd32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint32_t _hash(uint32_t v) { return (v * 2654435761u) >> (32 - LZ_HASH_BITS); }
+
+/*──────────────── compressão ──────────────────────────────*/
+/* resto de um comprimento ≥ 15: bytes de 255 e um final < 255 */
+static uint8_t *_len(uint8_t *o, const uint8_t *oend, size_t n)
+{
+    for (; n >= 255; n -= 255) { if (o >= oend) return NULL; *o++ = 255; }
+    if (o >= oend) return NULL;
+    *o++ = (uint8_t)n;
+    return o;
+}
+
+/* lit literais a partir de l e, se mlen ≠ 0, um match; NULL se estourou */
+static uint8_t *_seq(uint8_t *o, const uint8_t *oend, const uint8_t *l,
+                     size_t lit, size_t dist, size_t mlen)
+{
+    size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+    if (o >= oend) return NULL;
+    *o++ = (uint8_t)((lit < 15 ? lit : 15) << 4 | (ml < 15 ? ml : 15));
+    if (lit >= 15 && !(o = _len(o, oend, lit - 15))) return NULL;
+    if ((size_t)(oend - o) < lit) return NULL;
+    memcpy(o, l, lit);
+    o += lit;
+    if (!mlen) return o;
+    if (oend - o < 2) return NULL;
+    *o++ = (uint8_t)dist;
+    *o++ = (uint8_t)(dist >> 8);
+    if (ml >= 15 && !(o = _len(o, oend, ml - 15))) return NULL;
+    return o;
+}
+
+/* guloso, um candidato por hash de 4 bytes (sem cadeia) */
+size_t lz_pack(const void *src, size_t n, void *dst, size_t cap)
+{
+    const uint8_t *s = src;
+    uint8_t       *o = dst, *oend = o + cap;
+    uint32_t       tab[1u << LZ_HASH_BITS] = { 0 };      /* posição + 1 */
+    size_t         i = 0, anchor = 0;
+
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t v = _rd32(s + i), h = _hash(v);
+        size_t   c = tab[h];
+        tab[h] = (uint32_t)i + 1;
+        if (!c-- || i - c > LZ_MAX_DIST || _rd32(s + c) != v) {
+            i += 1 + ((i - anchor) >> LZ_SKIP_LOG);
+            continue;
+        }
+        size_t e = i + LZ_MIN_MATCH;
+        while (e < n && s[e] == s[c + (e - i)]) ++e;
+        while (i > anchor && c && s[i - 1] == s[c - 1]) { --i; --c; }
+        if (!(o = _seq(o, oend, s + anchor, i - anchor, i - c, e - i))) return 0;
+        i = anchor = e;
+        if (e >= 2 && e + 2 <= n) tab[_hash(_rd32(s + e - 2))] = (uint32_t)(e - 2) + 1;
+    }
+    if (anchor < n && !(o = _seq(o, oend, s + anchor, n - anchor, 0, 0))) return 0;
+    return (size_t)(o - (uint8_t *)dst);
+}
+
+/*──────────────── descompressão ───────────────────────────*/
+static int _ext(const uint8_t **i, const uint8_t *iend, size_t *n)
+{
+    uint8_t b;
+    do {
+        if (*i >= iend) return -1;
+        *n += b = *(*i)++;
+    } while (b == 255);
+    return 0;
+}
+
+int lz_unpack(const void *src, size_t cap, void *dst, size_t n)
+{
+    const uint8_t *i = src, *iend = i + cap;
+    uint8_t       *o = dst, *oend = o + n;
+
+    while (o < oend) {
+        if (i >= iend) return -1;
+        unsigned tok = *i++;
+        size_t   lit = tok >> 4, ml = tok & 15;
+        if (lit == 15 && _ext(&i, iend, &lit)) return -1;
+        if ((size_t)(iend - i) < lit || (size_t)(oend - o) < lit) return -1;
+        memcpy(o, i, lit);
+        o += lit; i += lit;
+        if (o == oend) break;                     /* última sequência */
+
+        if (iend - i < 2) return -1;
+        size_t dist = i[0] | (size_t)i[1] << 8;
+        i += 2;
+        if (ml == 15 && _ext(&i, iend, &ml)) return -1;
+        ml += LZ_MIN_MATCH;
+        if (!dist || dist > (size_t)(o - (uint8_t *)dst) || (size_t)(oend - o) < ml) return -1;
+
+        const uint8_t *m = o - dist;
+        if (dist >= ml) memcpy(o, m, ml);
+        else for (size_t k = 0; k < ml; ++k) o[k] = m[k];   /* repetição */
+        o += ml;
+    }
+    return 0;
+}
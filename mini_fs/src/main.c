@@ -4,12 +4,16 @@
 #include "fs.h"
 #include "auth.h"
 #include "directory.h"
+#include "shell.h"
+#include "server.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <getopt.h>     /* getopt_long */
+#include <unistd.h>     /* isatty */
 
-#define MAX_CMD 256
+#define BATCH_OUT_BUF  (1u << 20)     /* saída do modo lote, em blocos */
 
 /*── prompt ───────────────────────────────────────────────────*/
 static void prompt(void)
@@ -20,240 +24,124 @@ static void prompt(void)
     fflush(stdout);
 }
 
-/*── echo "txt" >|>> arq  ─────────────────────────────────────*/
-static int do_echo(char *line)
+/*── opções de linha de comando ───────────────────────────────*/
+static void usage(const char *prog)
 {
-    char *q1 = strchr(line, '"');  if (!q1) return -1;
-    char *q2 = strchr(q1 + 1, '"');if (!q2) return -1;
-    *q2 = '\0';
-    const char *txt = q1 + 1;
-
-    char *p = q2 + 1; while (*p==' ') ++p;
-    int append = 0;
-    if (!strncmp(p, ">>", 2)) { append = 1; p += 2; }
-    else if (*p == '>')       { append = 0; ++p; }
-    else return -1;
-    while (*p==' ') ++p;
-
-    return *p ? fs_echo(p, txt, append) : -1;
-}
-static int parse_two(const char *s, char *a, char *b)
-{ return sscanf(s, "%63s %63s", a, b) == 2 ? 0 : -1; }
-
-/*── re-autenticação do admin quando solicitada ───────────────*/
-static int admin_reauth(void)
-{
-    char pass[64];
-    printf("Senha admin: "); fgets(pass, sizeof pass, stdin);
-    pass[strcspn(pass, "\n")] = '\0';
-    User *adm = auth_get_user("admin");
-    return (adm && strcmp(adm->passwd, pass) == 0) ? 0 : -1;
-}
-
-/*── "rwx" → bits ─────────────────────────────────────────────*/
-static int rwx_to_bits(const char *s)
-{
-    if (strlen(s)!=3) return -1;
-    int b = 0;
-    if (s[0]=='r') b |= 4; else if (s[0]!='-') return -1;
-    if (s[1]=='w') b |= 2; else if (s[1]!='-') return -1;
-    if (s[2]=='x') b |= 1; else if (s[2]!='-') return -1;
-    return b;
-}
-
-/*── help contextual ─────────────────────────────────────────*/
-static void show_help(void)
-{
-    puts("Comandos principais");
-    puts("  pwd | ls [-l] | mkdir <dir> | cd <dir>");
-    puts("  touch <arq>");
-    puts("  echo \"txt\" > arq     ou   echo \"txt\" >> arq");
-    puts("  cat <arq> | rm <arq> | cp <orig> <dest> | mv <orig> <dest>");
-    puts("");
-    puts("Gerenciamento de grupo / perfil");
-    puts("  joingroup <grp>       (pede senha admin)");
-    puts("  sg <gid>              (muda GID efetivo)");
-    puts("  setperm <owner|group|public> rwx   (pede admin)");
-    puts("");
-    puts("Sessão");
-    puts("  logout   | exit");
-    puts("");
-
-    if (auth_is_admin()) {
-        puts("ADMIN (root)");
-        puts("  useradd  <nome> <uid> <gid> <senha> <perm-oct>");
-        puts("  userdel  <nome>");
-        puts("  groupadd <nome> <gid> <perm-oct>");
-        puts("  su <nome>");
-        puts("  chmod <octal> <arq>");
-        puts("  save");
-        puts("");
-    }
+    fprintf(stderr,
+            "Uso: %s [-i imagem] [-c blocos] [-s bytes-por-bloco] [-H] [-z]\n"
+            "       [-b script] [-u usuário] [-p senha] [-e]\n"
+            "       [--serve socket [-w workers]] [--stats-json arquivo]\n"
+            "  -i  imagem persistente (formatada com -c/-s se não existir)\n"
+            "  -c  capacidade máxima do volume em blocos (padrão %u)\n"
+            "  -s  tamanho do bloco, potência de 2 ≥ 512 (padrão %u)\n"
+            "  -H  usa transparent huge pages na área de dados\n"
+            "  -z  arquivos criados nesta sessão comprimem os blocos cheios\n"
+            "  -b  executa os comandos do arquivo (\"-\" = stdin) sem prompt;\n"
+            "      stdin que não é terminal também roda em lote\n"
+            "  -u  usuário do lote (senha em -p ou em $MFS_PASS)\n"
+            "  -e  no lote, para no primeiro comando com erro (saída 1)\n"
+            "  --serve  roda como daemon num socket UNIX (sem shell)\n"
+            "  -w  threads de trabalho do daemon (padrão: nº de CPUs)\n"
+            "  --stats-json  grava as estatísticas de operações ao sair\n",
+            prog, BLOCK_COUNT_DFLT, BLOCK_SIZE_DFLT);
 }
 
 /*─────────────────────────────────────────────────────────────*/
-int main(void)
+int main(int argc, char **argv)
 {
-    auth_init();   /* carrega users.db / groups.db */
-    fs_init();     /* inicia bloco + diretórios    */
-    if (!auth_login()) return 0;
-
-    char line[MAX_CMD];
-
-    while (1) {
-        prompt();
-        if (!fgets(line, sizeof line, stdin)) break;
-        line[strcspn(line, "\n")] = '\0';
-        if (!*line) continue;
-
-        /*── exit / logout ───────────────────────────────────*/
-        if (!strcmp(line,"exit")) { auth_save(); break; }
-
-        if (!strcmp(line,"logout")) {
-            auth_logout(); auth_save();
-            if (!auth_login()) break;
-            continue;
-        }
-
-        /*── bloco ADMIN (uid-0) ─────────────────────────────*/
-        if (auth_is_admin()) {
-            if (!strncmp(line,"useradd ",8)) {
-                char u[32], pw[32]; unsigned uid,gid,perm;
-                if (sscanf(line+8,"%31s %u %u %31s %o",
-                           u,&uid,&gid,pw,&perm)==5)
-                     puts(auth_useradd(u,uid,gid,pw,(uint16_t)perm)
-                          ?"falha":"ok");
-                else puts("Uso: useradd <n> <uid> <gid> <pw> <perm>");
-                continue;
-            }
-            if (!strncmp(line,"userdel ",8)) {
-                char u[32];
-                if (sscanf(line+8,"%31s",u)==1)
-                     puts(auth_delete_user(u)?"falha":"removido");
-                else puts("Uso: userdel <nome>");
-                auth_save(); continue;
-            }
-            if (!strncmp(line,"groupadd ",9)) {
-                char g[32]; unsigned gid,perm;
-                if (sscanf(line+9,"%31s %u %o",g,&gid,&perm)==3)
-                     puts(auth_groupadd(g,gid,(uint16_t)perm)
-                          ?"falha":"ok");
-                else puts("Uso: groupadd <n> <gid> <perm>");
-                auth_save(); continue;
-            }
-            if (!strncmp(line,"su ",3)) {
-                User *u = auth_get_user(line+3);
-                if (u){ auth_set_uid(u->uid); auth_set_gid(u->gid); }
-                else   puts("usuário inexistente");
-                continue;
-            }
-            if (!strncmp(line,"chmod ",6)) {
-                unsigned p; char f[64];
-                if (sscanf(line+6,"%o %63s",&p,f)==2)
-                     puts(fs_chmod(f,(uint16_t)p)?"falha":"ok");
-                else puts("Uso: chmod <octal> <arquivo>");
-                continue;
-            }
-            if (!strcmp(line,"save")){
-                puts(auth_save()?"falha":"BD salvo");
-                continue;
-            }
-        }
-
-        /*── joingroup ───────────────────────────────────────*/
-        if (!strncmp(line,"joingroup ",10)) {
-            char g[32];
-            if (sscanf(line+10,"%31s",g)!=1){ puts("Uso: joingroup <grp>"); continue; }
-            Group *grp = auth_get_group(g);
-            if (!grp){ puts("grupo inexistente"); continue; }
-            if (admin_reauth()){ puts("senha incorreta"); continue; }
-
-            User *me = auth_get_user_by_uid(auth_uid());
-            if (auth_add_user_to_group(me->name,g)==0){
-                auth_set_gid(grp->gid);
-                puts("adicionado ao grupo");
-                auth_save();
-            } else puts("falha joingroup");
-            continue;
+    size_t   nblocks = BLOCK_COUNT_DFLT, bsize = BLOCK_SIZE_DFLT;
+    unsigned bflags  = 0;
+    const char *image = NULL, *sock = NULL;
+    const char *script = NULL, *user = NULL, *pass = getenv("MFS_PASS");
+    bool stop_on_err = false;
+    int nworkers = 0;
+    static const struct option lopts[] = {
+        { "serve",      required_argument, NULL, 'S' },
+        { "stats-json", required_argument, NULL, 'J' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:c:s:Hzw:b:u:p:e", lopts, NULL)) != -1) {
+        switch (opt) {
+        case 'i': image   = optarg;                    break;
+        case 'c': nblocks = strtoull(optarg, NULL, 0); break;
+        case 's': bsize   = strtoull(optarg, NULL, 0); break;
+        case 'H': bflags |= BLOCK_F_HUGEPAGE;          break;
+        case 'z': bflags |= FS_F_ZIP;                  break;
+        case 'S': sock    = optarg;                    break;
+        case 'J': stats_dump_at_exit(optarg);          break;
+        case 'w': nworkers = atoi(optarg);             break;
+        case 'b': script  = optarg;                    break;
+        case 'u': user    = optarg;                    break;
+        case 'p': pass    = optarg;                    break;
+        case 'e': stop_on_err = true;                  break;
+        default:  usage(argv[0]); return 2;
         }
+    }
 
-        /*── setperm ─────────────────────────────────────────*/
-        if (!strncmp(line,"setperm ",8)) {
-            char cls[8],mask[4];
-            if (sscanf(line+8,"%7s %3s",cls,mask)!=2){
-                puts("Uso: setperm <owner|group|public> rwx"); continue;
-            }
-            int bits=rwx_to_bits(mask); if(bits<0){ puts("másc inválida"); continue; }
-            int sh = !strcmp(cls,"owner")?6:!strcmp(cls,"group")?3:
-                     !strcmp(cls,"public")?0:-1;
-            if (sh<0){ puts("classe inválida"); continue; }
-            if (admin_reauth()){ puts("senha incorreta"); continue; }
+    auth_init();   /* carrega users.db / groups.db */
+    if (fs_init(image, nblocks, bsize, bflags)) {  /* bloco + diretórios */
+        fprintf(stderr, "volume inválido: %zu blocos × %zu bytes\n",
+                nblocks, bsize);
+        return 1;
+    }
 
-            User *me=auth_get_user_by_uid(auth_uid());
-            me->dflt_perms=(me->dflt_perms & ~(7<<sh)) | (bits<<sh);
-            printf("Perm padrão → %03o\n",me->dflt_perms);
-            auth_save(); continue;
-        }
+    /*── daemon: cada cliente autentica na própria sessão ────*/
+    if (sock) {
+        int rc = server_run(sock, nworkers);
+        auth_save();
+        fs_shutdown();
+        return rc ? 1 : 0;
+    }
 
-        /*── sg ──────────────────────────────────────────────*/
-        if (!strncmp(line,"sg ",3)){
-            auth_set_gid((uint32_t)atoi(line+3));
-            continue;
-        }
+    /*── lote: sem prompt, saída em blocos grandes ──────────*/
+    FILE *in = stdin;
+    bool batch = script || !isatty(STDIN_FILENO);
+    if (script && strcmp(script, "-") && !(in = fopen(script, "r"))) {
+        perror(script);
+        fs_shutdown();
+        return 1;
+    }
+    if (batch) setvbuf(stdout, NULL, _IOFBF, BATCH_OUT_BUF);
+    shell_set_input(in);
+
+    /* sem -u o diálogo de login lê do stdin; com -b arquivo fica guest */
+    bool dialog = !user && in == stdin;
+    if (user ? !auth_authenticate(user, pass ? pass : "")
+             : dialog && !auth_login()) {
+        if (user) fprintf(stderr, "%s: login falhou\n", user);
+        fs_shutdown();
+        return user ? 1 : 0;
+    }
 
-        /*── Arquivos / diretórios ───────────────────────────*/
-        if (!strcmp(line,"pwd")){
-            char p[256]; puts(dir_pwd(p,sizeof p)); continue;
-        }
-        if (!strncmp(line,"ls",2)){
-            dir_ls(strstr(line,"-l")!=NULL); continue;
-        }
-        if (!strncmp(line,"mkdir ",6)){
-            if (dir_mkdir(line+6)) puts("mkdir: permissão negada");
-            continue;
-        }
-        if (!strncmp(line,"cd ",3)){
-            if (dir_cd(line+3))
-                puts("cd: permissão ou caminho inválido");
-            continue;
-        }
-        if (!strncmp(line,"touch ",6)){
-            if (fs_touch(line+6)) puts("touch: permissão negada");
-            continue;
-        }
+    char  *line = NULL, *copy = NULL;          /* shell_exec altera a linha */
+    size_t cap = 0;
+    ssize_t len;
+    unsigned long lineno = 0;
+    int status = 0;
 
-        if (!strncmp(line,"echo ",5)){
-            if (do_echo(line+5)<0)
-                puts("Uso: echo \"txt\" > arq  ou  echo \"txt\" >> arq");
-            continue;
-        }
-        if (!strncmp(line,"cat ",4)){
-            if (fs_cat(line+4)) puts("cat: permissão negada");
-            continue;
-        }
-        if (!strncmp(line,"rm ",3)){
-            if (fs_rm(line+3)) puts("rm: permissão negada");
-            continue;
-        }
-        if (!strncmp(line,"cp ",3)){
-            char a[64],b[64];
-            if (parse_two(line+3,a,b)==0){
-                if (fs_cp(a,b)) puts("cp: erro/permissão");
-            }else puts("Uso: cp <orig> <dest>");
-            continue;
-        }
-        if (!strncmp(line,"mv ",3)){
-            char a[64],b[64];
-            if (parse_two(line+3,a,b)==0){
-                if (fs_mv(a,b)) puts("mv: erro/permissão");
-            }else puts("Uso: mv <orig> <dest>");
-            continue;
+    while (1) {
+        if (!batch) prompt();
+        if ((len = getline(&line, &cap, in)) < 0) break;
+        ++lineno;
+        if (len && line[len - 1] == '\n') line[--len] = '\0';
+        if (batch && *line == '#') continue;          /* comentário */
+        if (stop_on_err) { g_free(copy); copy = g_strndup(line, len); }
+
+        int rc = shell_exec(line);
+        if (rc == SHELL_EXIT) break;
+        if (rc == SHELL_LOGOUT && dialog && !auth_login()) break;
+        if (rc == SHELL_ERR && batch && stop_on_err) {
+            fflush(stdout);
+            fprintf(stderr, "%s:%lu: falhou: %s\n",
+                    script ? script : "-", lineno, copy);
+            status = 1;
+            break;
         }
-
-        /* help */
-        if (!strcmp(line,"help")) { show_help(); continue; }
-
-        puts("Comando desconhecido — digite help");
     }
-    return 0;
+    free(line);
+    g_free(copy);
+    if (in != stdin) fclose(in);
+    fs_shutdown();   /* msync + marca a imagem como limpa */
+    return status;
 }
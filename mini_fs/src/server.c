@@ -0,0 +1,250 @@
+#define _GNU_SOURCE     /* accept4, signalfd */
+#include "server.h"
+#include "shell.h"
+#include "session.h"
+#include "auth.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>     /* pthread_sigmask */
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+/*  conexão: só um worker por vez a toca (EPOLLONESHOT) -------------------- */
+typedef struct {
+    int      fd;
+    Session *s;
+    GString *in;                   /* bytes recebidos sem '\n' ainda       */
+    GString *out;                  /* respostas do lote corrente           */
+    bool     authed;
+} Conn;
+
+/*──────────────── estado ──────────────────────────────────*/
+static int          _ep = -1;
+static GHashTable  *_conns;        /* Conn* vivas (para o desligamento)    */
+static GMutex       _conns_lock;
+static char         _tag_listen, _tag_signal;     /* data.ptr dos fds fixos */
+
+/*──────────────── conexões ────────────────────────────────*/
+static void _conn_free(Conn *c)
+{
+    close(c->fd);                  /* sai do epoll junto                   */
+    session_free(c->s);
+    g_string_free(c->in, TRUE);
+    g_string_free(c->out, TRUE);
+    g_free(c);
+}
+
+static void _drop(Conn *c)
+{
+    g_mutex_lock(&_conns_lock);
+    g_hash_table_remove(_conns, c);
+    g_mutex_unlock(&_conns_lock);
+    _conn_free(c);
+}
+
+static int _arm(Conn *c, int op)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+                              .data.ptr = c };
+    return epoll_ctl(_ep, op, c->fd, &ev);
+}
+
+/* grava tudo; socket não bloqueante → espera com poll se encher */
+static int _send_all(int fd, const char *p, size_t n)
+{
+    while (n) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w > 0) { p += w; n -= (size_t)w; continue; }
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pf = { .fd = fd, .events = POLLOUT };
+            if (poll(&pf, 1, SERVER_WRITE_MS) > 0) continue;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/*──────────────── um pedido ───────────────────────────────*/
+static void _reply(Conn *c, int rc, const char *txt, size_t len)
+{
+    g_string_append_printf(c->out, "%d %zu\n", rc, len);
+    g_string_append_len(c->out, txt, (gssize)len);
+}
+
+static int _request(Conn *c, char *line)
+{
+    if (!c->authed) {
+        char *argv[4];
+        if (shell_split(line, argv, 4) != 3 || strcmp(argv[0], "login")) {
+            static const char m[] = "login requerido: login <nome> <senha>\n";
+            _reply(c, SHELL_ERR, m, sizeof m - 1);
+            return SHELL_ERR;
+        }
+        c->authed = auth_authenticate(argv[1], argv[2]);
+        if (!c->authed) {
+            static const char m[] = "Senha incorreta\n";
+            _reply(c, SHELL_ERR, m, sizeof m - 1);
+            return SHELL_ERR;
+        }
+        _reply(c, SHELL_OK, "", 0);
+        return SHELL_OK;
+    }
+
+    char  *buf = NULL;
+    size_t len = 0;
+    FILE  *m = open_memstream(&buf, &len);
+    if (!m) return SHELL_EXIT;
+    c->s->out = m;
+    int rc = shell_exec(line);
+    c->s->out = NULL;
+    fclose(m);
+
+    _reply(c, rc, buf, len);
+    free(buf);
+    if (rc == SHELL_LOGOUT) c->authed = false;
+    return rc;
+}
+
+/*──────────────── worker ──────────────────────────────────*/
+/* lê o disponível (até SERVER_IN_MAX: quem não para de enviar não prende
+ * o worker – o resto fica no socket e o epoll rearmado chama de novo),
+ * executa cada linha completa e responde o lote de uma vez              */
+static void _serve(gpointer data, gpointer unused)
+{
+    (void)unused;
+    Conn    *c   = data;
+    Session *old = session_use(c->s);
+    bool     eof = false, quit = false;
+
+    char chunk[4096];
+    while (c->in->len <= SERVER_IN_MAX) {
+        ssize_t r = recv(c->fd, chunk, sizeof chunk, 0);
+        if (r > 0) { g_string_append_len(c->in, chunk, r); continue; }
+        if (r < 0 && errno == EINTR) continue;
+        if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) eof = true;
+        break;
+    }
+
+    char  *p = c->in->str, *nl;
+    while (!quit && (nl = memchr(p, '\n', c->in->len - (size_t)(p - c->in->str)))) {
+        *nl = '\0';
+        if (nl > p && nl[-1] == '\r') nl[-1] = '\0';
+        if (_request(c, p) == SHELL_EXIT) quit = true;
+        p = nl + 1;
+    }
+    g_string_erase(c->in, 0, p - c->in->str);
+    if (c->in->len > SERVER_IN_MAX) quit = true;           /* linha longa demais */
+
+    if (c->out->len && _send_all(c->fd, c->out->str, c->out->len)) quit = true;
+    g_string_truncate(c->out, 0);
+    session_use(old);
+
+    if (eof || quit || _arm(c, EPOLL_CTL_MOD)) _drop(c);
+}
+
+/*──────────────── laço de eventos ─────────────────────────*/
+static int _listen(const char *path)
+{
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof sa.sun_path) return -1;
+    strcpy(sa.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof sa) || listen(fd, SERVER_BACKLOG)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void _accept(int lfd)
+{
+    for (;;) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;                               /* EAGAIN: fila vazia */
+        }
+        Conn *c = g_new0(Conn, 1);
+        c->fd  = fd;
+        c->s   = session_new(1000, 1000);         /* guest até o login  */
+        c->in  = g_string_new(NULL);
+        c->out = g_string_new(NULL);
+
+        g_mutex_lock(&_conns_lock);
+        g_hash_table_add(_conns, c);
+        g_mutex_unlock(&_conns_lock);
+        if (_arm(c, EPOLL_CTL_ADD)) _drop(c);
+    }
+}
+
+int server_run(const char *path, int nworkers)
+{
+    if (nworkers <= 0) nworkers = (int)g_get_num_processors();
+
+    /* sinais viram eventos; as threads do pool herdam a máscara */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = _listen(path);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    _ep     = epoll_create1(EPOLL_CLOEXEC);
+    if (lfd < 0 || sfd < 0 || _ep < 0) {
+        perror("server");
+        if (lfd >= 0) { close(lfd); unlink(path); }
+        if (sfd >= 0) close(sfd);
+        if (_ep >= 0) close(_ep);
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &_tag_listen };
+    epoll_ctl(_ep, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.ptr = &_tag_signal;
+    epoll_ctl(_ep, EPOLL_CTL_ADD, sfd, &ev);
+
+    _conns = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GThreadPool *pool = g_thread_pool_new(_serve, NULL, nworkers, TRUE, NULL);
+    fprintf(stderr, "mfs: servindo em %s (%d workers)\n", path, nworkers);
+
+    struct epoll_event evs[64];
+    for (bool run = true; run; ) {
+        int n = epoll_wait(_ep, evs, (int)(sizeof evs / sizeof *evs), -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; ++i) {
+            void *tag = evs[i].data.ptr;
+            if      (tag == &_tag_listen) _accept(lfd);
+            else if (tag == &_tag_signal) run = false;
+            else    g_thread_pool_push(pool, tag, NULL);
+        }
+    }
+
+    /* termina os pedidos em curso; as conexões restantes estão ociosas */
+    g_thread_pool_free(pool, FALSE, TRUE);
+    GHashTableIter it;
+    gpointer c;
+    g_hash_table_iter_init(&it, _conns);
+    while (g_hash_table_iter_next(&it, &c, NULL)) _conn_free(c);
+    g_hash_table_destroy(_conns);
+    _conns = NULL;
+
+    close(_ep); _ep = -1;
+    close(sfd);
+    close(lfd);
+    unlink(path);
+    fprintf(stderr, "mfs: servidor encerrado\n");
+    return 0;
+}
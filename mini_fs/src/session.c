@@ -0,0 +1,61 @@
+#include "session.h"
+#include "auth.h"
+#include <stdarg.h>
+
+/*──────────────── estado ──────────────────────────────────*/
+static Session                _default = { .uid = 1000, .gid = 1000 };
+static _Thread_local Session *_bound;          /* sessão desta thread */
+
+/*──────────────── ciclo de vida ───────────────────────────*/
+Session *session_new(uint32_t uid, uint32_t gid)
+{
+    Session *s = g_new0(Session, 1);
+    Session *old = session_use(s);
+    auth_set_uid(uid);                         /* calcula os grupos */
+    auth_set_gid(gid);
+    session_use(old);
+    return s;
+}
+
+void session_free(Session *s)
+{
+    if (!s || s == &_default) return;
+    if (_bound == s) _bound = NULL;
+    if (s->gids)   g_array_free(s->gids, TRUE);
+    if (s->dcache) g_hash_table_destroy(s->dcache);
+    g_free(s);
+}
+
+Session *session_use(Session *s)
+{
+    Session *old = _bound;
+    _bound = s;
+    return old;
+}
+
+Session *session_current(void)
+{
+    return _bound ? _bound : &_default;
+}
+
+/*──────────────── saída ───────────────────────────────────*/
+FILE *session_out(void)
+{
+    FILE *f = session_current()->out;
+    return f ? f : stdout;
+}
+
+void session_puts(const char *s)
+{
+    FILE *f = session_out();
+    fputs(s, f);
+    fputc('\n', f);
+}
+
+void session_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(session_out(), fmt, ap);
+    va_end(ap);
+}
@@ -0,0 +1,351 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Interpretador de comandos do mini-filesystem               */
+/*─────────────────────────────────────────────────────────────*/
+#include "shell.h"
+#include "shell_cmds.h"
+#include "shell_hash.h"     /* gerado: semente + slots do hash perfeito */
+#include "fs.h"
+#include "auth.h"
+#include "directory.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>     /* isatty */
+
+#define say   session_puts
+#define USAGE (-2)      /* handler → "Uso: ..." da tabela */
+
+static FILE *_in;       /* senha admin do console; NULL = stdin */
+
+void shell_set_input(FILE *in) { _in = in; }
+
+/*──────────────── tokenizador ─────────────────────────────*/
+/* operadores de redireção viram tokens próprios (fora de aspas) */
+static char _gt[] = ">", _gtgt[] = ">>";
+
+int shell_split(char *line, char **argv, int max)
+{
+    int   argc = 0;
+    char *r = line, *w = line;          /* lê em r, compacta em w (w ≤ r) */
+
+    for (;;) {
+        while (*r == ' ' || *r == '\t') ++r;
+        if (!*r) return argc;
+        if (argc == max) return -1;
+
+        if (*r == '>') {                /* > ou >> */
+            argv[argc++] = r[1] == '>' ? (r += 2, _gtgt) : (++r, _gt);
+            continue;
+        }
+
+        char *tok = w, q = 0;
+        for (; *r; ++r) {
+            if (q) {                                    /* entre aspas */
+                if (*r == q) { q = 0; continue; }
+                if (q == '"' && *r == '\\' && (r[1] == '"' || r[1] == '\\')) ++r;
+            } else {
+                if (*r == ' ' || *r == '\t' || *r == '>') break;
+                if (*r == '"' || *r == '\'') { q = *r; continue; }
+                if (*r == '\\' && r[1]) ++r;
+            }
+            *w++ = *r;
+        }
+        if (q) return -1;               /* aspas sem fechar */
+
+        /* o '\0' pode cair sobre o separador: decide antes */
+        char sep = *r;
+        int  op  = sep == '>' ? (r[1] == '>' ? 2 : 1) : 0;
+        *w++ = '\0';
+        argv[argc++] = tok;
+        if (!sep) return argc;
+        if (op) {
+            if (argc == max) return -1;
+            argv[argc++] = op == 2 ? _gtgt : _gt;
+            r += op;
+        } else ++r;
+    }
+}
+
+/*──────────────── utilitários ─────────────────────────────*/
+/* inteiro completo (sem sobra) na base dada */
+static int _num(const char *s, int base, unsigned *out)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, base);
+    if (!*s || *end || v > UINT32_MAX) return -1;
+    *out = (unsigned)v;
+    return 0;
+}
+
+/* nomes e senhas vão para users.db / groups.db separados por espaço */
+static bool _plain(const char *s) { return *s && !strpbrk(s, " \t:"); }
+
+/*── re-autenticação do admin quando solicitada ───────────────*/
+/* a senha pode vir na própria linha; só o console pergunta */
+static int admin_reauth(const char *given)
+{
+    char pass[64];
+    if (!given) {
+        if (session_out() != stdout) { say("senha admin requerida"); return -1; }
+        FILE *in = _in ? _in : stdin;
+        if (isatty(fileno(in))) { printf("Senha admin: "); fflush(stdout); }
+        if (!fgets(pass, sizeof pass, in)) return -1;
+        pass[strcspn(pass, "\n")] = '\0';
+        given = pass;
+    }
+    return auth_check_passwd("admin", given) ? 0 : -1;
+}
+
+/*── "rwx" → bits ─────────────────────────────────────────────*/
+static int rwx_to_bits(const char *s)
+{
+    if (strlen(s)!=3) return -1;
+    int b = 0;
+    if (s[0]=='r') b |= 4; else if (s[0]!='-') return -1;
+    if (s[1]=='w') b |= 2; else if (s[1]!='-') return -1;
+    if (s[2]=='x') b |= 1; else if (s[2]!='-') return -1;
+    return b;
+}
+
+/*── help contextual ─────────────────────────────────────────*/
+void shell_help(void)
+{
+    say("Comandos principais");
+    say("  pwd | ls [-l] | mkdir <dir> | cd <dir>");
+    say("  touch <arq>");
+    say("  echo \"txt\" > arq     ou   echo \"txt\" >> arq");
+    say("  cat <arq> | rm <arq> | cp <orig> <dest> | mv <orig> <dest>");
+    say("  compress <arq> on|off (blocos cheios guardados comprimidos)");
+    say("  (\"...\", '...' e \\ protegem espaços nos argumentos)");
+    say("");
+    say("Gerenciamento de grupo / perfil");
+    say("  joingroup <grp> [senha-admin]");
+    say("  sg <gid>              (muda GID efetivo)");
+    say("  setperm <owner|group|public> rwx [senha-admin]");
+    say("");
+    say("Diagnóstico");
+    say("  stats [reset]         (contadores e latências por operação)");
+    say("");
+    say("Sessão");
+    say("  logout   | exit");
+    say("");
+
+    if (auth_is_admin()) {
+        say("ADMIN (root)");
+        say("  useradd  <nome> <uid> <gid> <senha> <perm-oct>");
+        say("  userdel  <nome>");
+        say("  groupadd <nome> <gid> <perm-oct>");
+        say("  su <nome>");
+        say("  chmod <octal> <arq>");
+        say("  save");
+        say("  trace start|stop|dump <arq.json>   (eventos no formato Chrome)");
+        say("");
+    }
+}
+
+/*──────────────── comandos ────────────────────────────────*/
+/* argv[0] é o nome; a contagem já foi checada pela tabela */
+#define CMD(n) static int cmd_##n(int argc, char **argv)
+#define OK_OR(rc, msg) do { if (!(rc)) return SHELL_OK;               \
+                            say(msg); return SHELL_ERR; } while (0)
+
+/*── exit / logout ───────────────────────────────────────────*/
+CMD(exit)   { (void)argc; (void)argv; auth_save(); return SHELL_EXIT; }
+CMD(logout) { (void)argc; (void)argv; auth_logout(); auth_save(); return SHELL_LOGOUT; }
+CMD(help)   { (void)argc; (void)argv; shell_help(); return SHELL_OK; }
+
+/*── Arquivos / diretórios ───────────────────────────────────*/
+CMD(pwd)
+{
+    (void)argc; (void)argv;
+    char p[256]; say(dir_pwd(p,sizeof p));
+    return SHELL_OK;
+}
+CMD(ls)
+{
+    if (argc == 2 && strcmp(argv[1],"-l")) return USAGE;
+    dir_ls(argc == 2);
+    return SHELL_OK;
+}
+CMD(mkdir) { (void)argc; OK_OR(dir_mkdir(argv[1]), "mkdir: permissão negada"); }
+CMD(cd)    { (void)argc; OK_OR(dir_cd(argv[1]),    "cd: permissão ou caminho inválido"); }
+CMD(touch) { (void)argc; OK_OR(fs_touch(argv[1]),  "touch: permissão negada"); }
+CMD(cat)   { (void)argc; OK_OR(fs_cat(argv[1]),    "cat: erro/permissão"); }
+CMD(rm)    { (void)argc; OK_OR(fs_rm(argv[1]),     "rm: permissão negada"); }
+CMD(cp)    { (void)argc; OK_OR(fs_cp(argv[1],argv[2]), "cp: erro/permissão"); }
+CMD(mv)    { (void)argc; OK_OR(fs_mv(argv[1],argv[2]), "mv: erro/permissão"); }
+CMD(compress)
+{
+    (void)argc;
+    bool on = !strcmp(argv[2], "on");
+    if (!on && strcmp(argv[2], "off")) return USAGE;
+    OK_OR(fs_compress(argv[1], on), "compress: permissão negada ou sem espaço");
+}
+
+/*── echo "txt" >|>> arq ─────────────────────────────────────*/
+CMD(echo)
+{
+    (void)argc;
+    int append = argv[2] == _gtgt;
+    if (!append && argv[2] != _gt) return USAGE;
+    OK_OR(fs_echo(argv[3], argv[1], append) < 0, "echo: permissão negada");
+}
+
+/*── joingroup ───────────────────────────────────────────────*/
+CMD(joingroup)
+{
+    uint32_t gid;
+    if (auth_get_gid_by_name(argv[1], &gid)){ say("grupo inexistente"); return SHELL_ERR; }
+    if (admin_reauth(argc > 2 ? argv[2] : NULL)){ say("senha incorreta"); return SHELL_ERR; }
+
+    if (auth_join_group(auth_uid(), argv[1])!=0){
+        say("falha joingroup");
+        return SHELL_ERR;
+    }
+    auth_set_gid(gid);
+    say("adicionado ao grupo");
+    auth_save();
+    return SHELL_OK;
+}
+
+/*── sg ──────────────────────────────────────────────────────*/
+CMD(sg)
+{
+    (void)argc;
+    unsigned gid;
+    if (_num(argv[1], 10, &gid)) return USAGE;
+    auth_set_gid(gid);
+    return SHELL_OK;
+}
+
+/*── setperm ─────────────────────────────────────────────────*/
+CMD(setperm)
+{
+    const char *cls = argv[1];
+    int bits=rwx_to_bits(argv[2]); if(bits<0){ say("másc inválida"); return SHELL_ERR; }
+    int sh = !strcmp(cls,"owner")?6:!strcmp(cls,"group")?3:
+             !strcmp(cls,"public")?0:-1;
+    if (sh<0){ say("classe inválida"); return SHELL_ERR; }
+    if (admin_reauth(argc > 3 ? argv[3] : NULL)){ say("senha incorreta"); return SHELL_ERR; }
+
+    int perms=auth_set_class_perms(auth_uid(),sh,(uint16_t)bits);
+    if (perms<0) return SHELL_ERR;
+    session_printf("Perm padrão → %03o\n",perms);
+    auth_save();
+    return SHELL_OK;
+}
+
+/*── stats ───────────────────────────────────────────────────*/
+CMD(stats)
+{
+    if (argc == 1) { stats_print(session_out()); return SHELL_OK; }
+    if (strcmp(argv[1], "reset")) return USAGE;
+    if (!auth_is_admin()) { say("stats reset: só admin"); return SHELL_ERR; }
+    stats_reset();
+    return SHELL_OK;
+}
+
+/*── bloco ADMIN (uid-0) ─────────────────────────────────────*/
+CMD(useradd)
+{
+    (void)argc;
+    unsigned uid,gid,perm;
+    if (!_plain(argv[1]) || !_plain(argv[4]) || _num(argv[2],10,&uid) ||
+        _num(argv[3],10,&gid) || _num(argv[5],8,&perm)) return USAGE;
+    int rc = auth_useradd(argv[1],uid,gid,argv[4],(uint16_t)perm);
+    say(rc?"falha":"ok");
+    return rc ? SHELL_ERR : SHELL_OK;
+}
+CMD(userdel)
+{
+    (void)argc;
+    int rc = auth_delete_user(argv[1]);
+    say(rc?"falha":"removido");
+    auth_save();
+    return rc ? SHELL_ERR : SHELL_OK;
+}
+CMD(groupadd)
+{
+    (void)argc;
+    unsigned gid,perm;
+    if (!_plain(argv[1]) || _num(argv[2],10,&gid) || _num(argv[3],8,&perm)) return USAGE;
+    int rc = auth_groupadd(argv[1],gid,(uint16_t)perm);
+    say(rc?"falha":"ok");
+    auth_save();
+    return rc ? SHELL_ERR : SHELL_OK;
+}
+CMD(su)
+{
+    (void)argc;
+    User u;
+    if (!auth_get_user(argv[1], &u)) { say("usuário inexistente"); return SHELL_ERR; }
+    auth_set_uid(u.uid); auth_set_gid(u.gid);
+    return SHELL_OK;
+}
+CMD(chmod)
+{
+    (void)argc;
+    unsigned p;
+    if (_num(argv[1], 8, &p)) return USAGE;
+    int rc = fs_chmod(argv[2],(uint16_t)p);
+    say(rc?"falha":"ok");
+    return rc ? SHELL_ERR : SHELL_OK;
+}
+CMD(save)
+{
+    (void)argc; (void)argv;
+    int rc = auth_save()||fs_sync();
+    say(rc?"falha":"BD salvo");
+    return rc ? SHELL_ERR : SHELL_OK;
+}
+
+CMD(trace)
+{
+    const char *op = argv[1];
+    if (argc == 2 && !strcmp(op, "start")) { trace_start(); say("trace ligado"); return SHELL_OK; }
+    if (argc == 2 && !strcmp(op, "stop"))  { trace_stop();  say("trace desligado"); return SHELL_OK; }
+    if (argc != 3 || strcmp(op, "dump")) return USAGE;
+    if (trace_dump(argv[2])) { session_printf("trace: %s: %s\n", argv[2], strerror(errno)); return SHELL_ERR; }
+    say("trace gravado");
+    return SHELL_OK;
+}
+
+/*──────────────── tabela + despacho ───────────────────────*/
+typedef struct {
+    const char *name;
+    int       (*run)(int, char **);
+    uint8_t     amin, amax, flags;
+    const char *usage;
+} Cmd;
+
+#define ENTRY(n, lo, hi, fl, us) { #n, cmd_##n, lo, hi, fl, us },
+static const Cmd cmds[] = { SHELL_COMMANDS(ENTRY) };
+
+/* um hash + um strcmp, qualquer que seja o nº de comandos */
+static const Cmd *_lookup(const char *name)
+{
+    int i = shell_slot[shell_hash(name, SHELL_HASH_SEED) & SHELL_HASH_MASK];
+    return i >= 0 && !strcmp(cmds[i].name, name) ? &cmds[i] : NULL;
+}
+
+/*── um comando ──────────────────────────────────────────────*/
+int shell_exec(char *line)
+{
+    char *argv[SHELL_ARGS_MAX];
+    int argc = shell_split(line, argv, SHELL_ARGS_MAX);
+    if (argc == 0) return SHELL_OK;
+    if (argc < 0) { say("linha inválida: aspas sem fechar ou argumentos demais"); return SHELL_ERR; }
+
+    const Cmd *c = _lookup(argv[0]);
+    if (!c || ((c->flags & SH_ADMIN) && !auth_is_admin())) {
+        say("Comando desconhecido — digite help");
+        return SHELL_ERR;
+    }
+    int rc = argc - 1 < c->amin || argc - 1 > c->amax ? USAGE : c->run(argc, argv);
+    if (rc == USAGE) { session_printf("Uso: %s\n", c->usage); rc = SHELL_ERR; }
+    return rc;
+}
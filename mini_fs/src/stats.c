@@ -0,0 +1,171 @@
+#include "stats.h"
+#include <glib.h>       /* GMutex, GPrivate */
+#include <stdlib.h>
+#include <string.h>
+
+static const struct { const char *name; bool timed; } _ops[ST__N] = {
+#define STATS_INFO(id, name, timed) { name, timed },
+    STATS_OPS(STATS_INFO)
+#undef STATS_INFO
+};
+
+const char *stats_name (stat_op op) { return op < ST__N ? _ops[op].name : "?"; }
+bool        stats_timed(stat_op op) { return op < ST__N && _ops[op].timed; }
+
+uint64_t stats_percentile(const StatCounter *c, double p)
+{
+    uint64_t n = 0, seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; ++b) n += c->hist[b];
+    if (!n) return 0;
+    uint64_t want = (uint64_t)(p * (double)n + 0.5);
+    if (!want) want = 1;
+    for (int b = 0; b < STATS_BUCKETS; ++b)
+        if ((seen += c->hist[b]) >= want) return 2ull << b;
+    return 2ull << (STATS_BUCKETS - 1);
+}
+
+#ifdef MFS_NO_STATS
+
+bool stats_enabled(void) { return false; }
+void stats_snapshot(StatCounter out[ST__N]) { memset(out, 0, ST__N * sizeof *out); }
+void stats_reset(void) {}
+
+#else
+
+/*──────────────── estado ──────────────────────────────────*/
+_Thread_local StatsTls *stats_tls;
+
+static GMutex     _lock;               /* _live e _retired                 */
+static GPtrArray *_live;               /* StatsTls* das threads vivas      */
+static StatsTls   _retired;            /* somas de threads que já saíram   */
+static void _exit_thread(gpointer p);
+static GPrivate   _key = G_PRIVATE_INIT(_exit_thread);
+
+bool stats_enabled(void) { return true; }
+
+static void _sum(StatCounter *dst, const StatCounter *src)
+{
+    const uint64_t *s = (const uint64_t *)src;
+    uint64_t       *d = (uint64_t *)dst;
+    for (size_t i = 0; i < sizeof *src / sizeof *s; ++i)
+        d[i] += __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+}
+
+StatsTls *stats_tls_init(void)
+{
+    StatsTls *t = g_new0(StatsTls, 1);
+    g_mutex_lock(&_lock);
+    if (!_live) _live = g_ptr_array_new();
+    g_ptr_array_add(_live, t);
+    g_mutex_unlock(&_lock);
+    g_private_set(&_key, t);
+    return stats_tls = t;
+}
+
+/* a thread sai: os contadores dela vão para _retired */
+static void _exit_thread(gpointer p)
+{
+    StatsTls *t = p;
+    g_mutex_lock(&_lock);
+    for (int op = 0; op < ST__N; ++op) _sum(&_retired.c[op], &t->c[op]);
+    g_ptr_array_remove_fast(_live, t);
+    g_mutex_unlock(&_lock);
+    g_free(t);
+}
+
+void stats_snapshot(StatCounter out[ST__N])
+{
+    g_mutex_lock(&_lock);
+    memcpy(out, _retired.c, sizeof _retired.c);
+    for (guint i = 0; _live && i < _live->len; ++i) {
+        StatsTls *t = g_ptr_array_index(_live, i);
+        for (int op = 0; op < ST__N; ++op) _sum(&out[op], &t->c[op]);
+    }
+    g_mutex_unlock(&_lock);
+}
+
+/* zera tudo; contagens em curso noutras threads podem sobreviver */
+void stats_reset(void)
+{
+    g_mutex_lock(&_lock);
+    memset(&_retired, 0, sizeof _retired);
+    for (guint i = 0; _live && i < _live->len; ++i) {
+        uint64_t *w = (uint64_t *)g_ptr_array_index(_live, i);
+        for (size_t k = 0; k < sizeof(StatsTls) / sizeof *w; ++k)
+            __atomic_store_n(&w[k], 0, __ATOMIC_RELAXED);
+    }
+    g_mutex_unlock(&_lock);
+}
+
+#endif /* MFS_NO_STATS */
+
+/*──────────────── relatórios ──────────────────────────────*/
+void stats_print(FILE *out)
+{
+    if (!stats_enabled()) { fputs("estatísticas desativadas na compilação\n", out); return; }
+
+    StatCounter *s = g_new(StatCounter, ST__N);
+    stats_snapshot(s);
+    fprintf(out, "%-18s %10s %8s %12s %10s %10s %10s\n",
+            "operação", "chamadas", "erros", "bytes", "média µs", "p50 µs", "p99 µs");
+    for (int op = 0; op < ST__N; ++op) {
+        const StatCounter *c = &s[op];
+        if (!c->calls) continue;
+        fprintf(out, "%-18s %10llu %8llu %12llu", _ops[op].name,
+                (unsigned long long)c->calls, (unsigned long long)c->errors,
+                (unsigned long long)c->bytes);
+        if (_ops[op].timed)
+            fprintf(out, " %10.2f %10.2f %10.2f\n",
+                    c->ns / 1e3 / c->calls,
+                    stats_percentile(c, .50) / 1e3, stats_percentile(c, .99) / 1e3);
+        else
+            fputs("          -          -          -\n", out);
+    }
+    g_free(s);
+}
+
+int stats_dump_json(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    StatCounter *s = g_new(StatCounter, ST__N);
+    stats_snapshot(s);
+    fprintf(f, "{\n  \"enabled\": %s,\n  \"bucket\": \"log2_ns\",\n  \"ops\": {",
+            stats_enabled() ? "true" : "false");
+    bool first = true;
+    for (int op = 0; op < ST__N; ++op) {
+        const StatCounter *c = &s[op];
+        if (!c->calls) continue;
+        fprintf(f, "%s\n    \"%s\": { \"calls\": %llu, \"errors\": %llu, \"bytes\": %llu",
+                first ? "" : ",", _ops[op].name, (unsigned long long)c->calls,
+                (unsigned long long)c->errors, (unsigned long long)c->bytes);
+        first = false;
+        if (_ops[op].timed) {
+            int last = STATS_BUCKETS - 1;
+            while (last > 0 && !c->hist[last]) --last;
+            fprintf(f, ", \"ns\": %llu, \"hist\": [", (unsigned long long)c->ns);
+            for (int b = 0; b <= last; ++b)
+                fprintf(f, "%s%llu", b ? ", " : "", (unsigned long long)c->hist[b]);
+            fputc(']', f);
+        }
+        fputs(" }", f);
+    }
+    fputs("\n  }\n}\n", f);
+    g_free(s);
+    return fclose(f) ? -1 : 0;
+}
+
+static char *_exit_path;
+static void _at_exit(void)
+{
+    if (_exit_path && stats_dump_json(_exit_path))
+        perror(_exit_path);
+}
+
+void stats_dump_at_exit(const char *path)
+{
+    if (!_exit_path) atexit(_at_exit);
+    g_free(_exit_path);
+    _exit_path = g_strdup(path);
+}
@@ -0,0 +1,139 @@
+#include "trace.h"
+#include <glib.h>       /* GMutex, GPrivate, GPtrArray */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>     /* getpid */
+
+/*──────────────── estado ──────────────────────────────────*/
+/*  Um anel por thread, escrito só pela dona. Os anéis nunca são
+ *  liberados: quando a thread sai o anel fica órfão (o conteúdo
+ *  continua no dump) e é adotado pela próxima thread nova.       */
+typedef struct {
+    uint64_t head;                     /* registros já gravados          */
+    uint32_t gen;                      /* trace_start visto pela dona    */
+    uint32_t tid;                      /* 1, 2, … na ordem de criação    */
+    bool     owned;
+    TraceRec rec[TRACE_RING];
+} TraceRing;
+
+bool trace_on;
+
+static uint32_t   _gen;                /* ++ a cada trace_start          */
+static uint64_t   _t_start;            /* origem do eixo no dump         */
+static GMutex     _lock;               /* _rings e owned                 */
+static GPtrArray *_rings;
+static _Thread_local TraceRing *_mine;
+static void _orphan(gpointer p);
+static GPrivate   _key = G_PRIVATE_INIT(_orphan);
+
+static TraceRing *_adopt(void)
+{
+    TraceRing *r = NULL;
+    g_mutex_lock(&_lock);
+    if (!_rings) _rings = g_ptr_array_new();
+    for (guint i = 0; !r && i < _rings->len; ++i) {
+        TraceRing *o = g_ptr_array_index(_rings, i);
+        if (!o->owned) r = o;
+    }
+    if (!r) {
+        r = g_new0(TraceRing, 1);
+        r->tid = _rings->len + 1;
+        g_ptr_array_add(_rings, r);
+    }
+    r->owned = true;
+    g_mutex_unlock(&_lock);
+    g_private_set(&_key, r);
+    return _mine = r;
+}
+
+static void _orphan(gpointer p)
+{
+    g_mutex_lock(&_lock);
+    ((TraceRing *)p)->owned = false;
+    g_mutex_unlock(&_lock);
+}
+
+/*──────────────── controle ────────────────────────────────*/
+/* cada anel se zera sozinho na 1ª gravação da nova geração */
+void trace_start(void)
+{
+    g_mutex_lock(&_lock);
+    _t_start = trace_now();
+    __atomic_add_fetch(&_gen, 1, __ATOMIC_RELEASE);
+    g_mutex_unlock(&_lock);
+    __atomic_store_n(&trace_on, true, __ATOMIC_RELEASE);
+}
+
+void trace_stop(void)   { __atomic_store_n(&trace_on, false, __ATOMIC_RELEASE); }
+bool trace_active(void) { return __atomic_load_n(&trace_on, __ATOMIC_RELAXED); }
+
+void trace_emit(unsigned op, uint64_t t0, uint32_t key,
+                int32_t a, int32_t b, long long rc)
+{
+    uint64_t   t1 = trace_now();
+    TraceRing *r  = _mine ? _mine : _adopt();
+    uint32_t   g  = __atomic_load_n(&_gen, __ATOMIC_ACQUIRE);
+    if (r->gen != g) { r->gen = g; __atomic_store_n(&r->head, 0, __ATOMIC_RELEASE); }
+
+    r->rec[r->head & (TRACE_RING - 1)] = (TraceRec){
+        .t0 = t0, .t1 = t1, .rc = rc, .key = key, .a = a, .b = b, .op = (uint16_t)op };
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/*──────────────── exportação ──────────────────────────────*/
+static const char *_name(unsigned op)
+{ return op == TRACE_PERM ? "auth_has_perm_mode" : stats_name((stat_op)op); }
+
+static void _args(FILE *f, const TraceRec *e)
+{
+    switch (e->op) {
+    case TRACE_PERM:
+        fprintf(f, "\"owner\":%d,\"group\":%d", e->a, e->b); break;
+    case ST_BLK_ALLOC: case ST_BLK_FREE: case ST_BLK_ALLOC_RANGE: case ST_BLK_FREE_RANGE:
+        fprintf(f, "\"block\":%d,\"n\":%d", e->a, e->b); break;
+    case ST_BLK_ZPACK: case ST_BLK_ZUNPACK:
+        fprintf(f, "\"block\":%d,\"zcap\":%d", e->a, e->b); break;
+    case ST_FS_CLOSE: case ST_FS_READ: case ST_FS_WRITE:
+        fprintf(f, "\"fd\":%u", e->key); break;
+    default:
+        fprintf(f, "\"path\":\"%08x\"", e->key);
+    }
+    fprintf(f, ",\"rc\":%lld", (long long)e->rc);
+}
+
+/* com o tracer ainda ligado é melhor esforço: um anel que der a volta
+ * durante a leitura pode trazer registros misturados                */
+int trace_dump(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    int  pid   = (int)getpid();
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+    g_mutex_lock(&_lock);
+    uint32_t g = __atomic_load_n(&_gen, __ATOMIC_ACQUIRE);
+    for (guint i = 0; _rings && i < _rings->len; ++i) {
+        TraceRing *r = g_ptr_array_index(_rings, i);
+        if (__atomic_load_n(&r->gen, __ATOMIC_RELAXED) != g) continue;
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t from = head > TRACE_RING ? head - TRACE_RING : 0;
+
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                   "\"args\":{\"name\":\"mfs-%u\"}}", first ? "" : ",", pid, r->tid, r->tid);
+        first = false;
+        for (uint64_t k = from; k < head; ++k) {
+            const TraceRec *e = &r->rec[k & (TRACE_RING - 1)];
+            const char *n = _name(e->op);
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%.*s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                       "\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                    n, (int)strcspn(n, "_"), n, pid, r->tid,
+                    ((double)e->t0 - (double)_t_start) / 1e3, (double)(e->t1 - e->t0) / 1e3);
+            _args(f, e);
+            fputs("}}", f);
+        }
+    }
+    g_mutex_unlock(&_lock);
+    fputs("\n]}\n", f);
+    return fclose(f) ? -1 : 0;
+}
@@ -0,0 +1,363 @@
+#include "volume.h"
+#include "block.h"
+#include "journal.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>      /* open            */
+#include <unistd.h>     /* pread, ftruncate */
+#include <sys/mman.h>   /* mmap, msync     */
+#include <sys/stat.h>
+
+#define VOL_ALIGN  4096u                     /* alinhamento das regiões */
+#define ALIGN_UP(x,a)  (((x) + (a) - 1) / (a) * (a))
+
+_Static_assert(sizeof(VolInode) == 256, "VolInode deve ter 256 bytes");
+_Static_assert(FS_INLINE_MAX <= VOL_INLINE_MAX, "inline do FCB não cabe no inode");
+
+/*──────────────── estado da imagem montada ────────────────*/
+static int       _fd = -1;
+static uint8_t  *_map;            /* metadados [0, data_off): privado   */
+static size_t    _len;
+static uint8_t  *_data;           /* blocos [data_off, fim): compartilhado */
+static size_t    _dlen;
+static VolSuper *_sb;
+static VolInode *_itab;
+static GArray   *_ifree;          /* slots livres abaixo de hwm (pilha) */
+static GMutex    _ilock;          /* _ifree + inode_hwm entre threads   */
+
+/* bloco de extents excedentes: encadeado a partir de VolInode.ext_blk */
+typedef struct {
+    uint32_t next;                /* VOL_NO_BLOCK no último          */
+    uint32_t count;
+    Extent   ext[];
+} ExtBlock;
+
+/*──────────────── helpers ─────────────────────────────────*/
+static uint32_t _csum(const VolSuper *sb)
+{
+    const uint8_t *p = (const uint8_t *)sb;
+    uint32_t h = 2166136261u;                      /* FNV-1a */
+    for (size_t i = 0; i < offsetof(VolSuper, csum); ++i)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static void _layout(VolSuper *sb, size_t nblocks, size_t bsize)
+{
+    memset(sb, 0, sizeof *sb);
+    memcpy(sb->magic, VOL_MAGIC, sizeof sb->magic);
+    sb->version    = VOL_VERSION;
+    sb->block_size = (uint32_t)bsize;
+    sb->capacity   = nblocks;
+    sb->ninodes    = MAX(nblocks, 16) * VOL_INODE_RATIO; /* arquivos inline
+                                                       * não gastam bloco */
+
+    uint64_t words = (nblocks + 63) / 64;
+    sb->bitmap_off = VOL_ALIGN;
+    sb->ref_off    = ALIGN_UP(sb->bitmap_off + words * 8, VOL_ALIGN);
+    sb->itab_off   = ALIGN_UP(sb->ref_off + nblocks * 4, VOL_ALIGN);
+    sb->data_off   = ALIGN_UP(sb->itab_off + sb->ninodes * sizeof(VolInode),
+                              bsize > VOL_ALIGN ? bsize : VOL_ALIGN);
+    sb->image_size = sb->data_off + (uint64_t)nblocks * bsize;
+    sb->csum       = _csum(sb);
+}
+
+static bool _valid_super(const VolSuper *sb, uint64_t file_size)
+{
+    return !memcmp(sb->magic, VOL_MAGIC, sizeof sb->magic) &&
+           sb->version == VOL_VERSION &&
+           sb->csum == _csum(sb) &&
+           sb->image_size == file_size &&
+           sb->inode_hwm <= sb->ninodes;
+}
+
+static size_t _ext_per_block(void)
+{
+    return (block_size() - sizeof(ExtBlock)) / sizeof(Extent);
+}
+
+static ExtBlock *_eb(uint32_t blk)
+{
+    return (ExtBlock *)(_data + (uint64_t)blk * _sb->block_size);
+}
+
+/* toda alteração de metadado passa pelo journal */
+#define LOG(x)  jnl_log(&(x), sizeof (x))
+
+static void _chain_free(uint32_t blk)
+{
+    while (blk != VOL_NO_BLOCK) {
+        uint32_t next = _eb(blk)->next;
+        block_free((int)blk);
+        blk = next;
+    }
+}
+
+/*──────────────── formatação / montagem ───────────────────*/
+/* a formatação grava direto no arquivo; depois a imagem é montada
+ * como qualquer outra                                               */
+static int _format(size_t nblocks, size_t bsize)
+{
+    if (!nblocks || nblocks > INT32_MAX ||
+        bsize < 512 || (bsize & (bsize - 1))) return -1;
+
+    VolSuper sb;
+    _layout(&sb, nblocks, bsize);
+    sb.inode_hwm = 1;
+    sb.clean     = 1;
+    if (ftruncate(_fd, (off_t)sb.image_size)) return -1;   /* esparso */
+
+    /* bits além da capacidade ficam "ocupados" para sempre */
+    uint64_t tail = ~0ULL << (nblocks % 64);
+    if (nblocks % 64 &&
+        pwrite(_fd, &tail, sizeof tail, (off_t)(sb.bitmap_off + nblocks / 64 * 8)) != sizeof tail)
+        return -1;
+
+    /* inode 0 = raiz "/" */
+    VolInode root = { .kind = VI_DIR, .perms = 0755, .ext_blk = VOL_NO_BLOCK };
+    strcpy(root.name, "/");
+    if (pwrite(_fd, &root, sizeof root, (off_t)sb.itab_off) != sizeof root ||
+        pwrite(_fd, &sb, sizeof sb, 0) != sizeof sb)
+        return -1;
+    return fsync(_fd);
+}
+
+/* metadados: MAP_PRIVATE – só chegam ao arquivo via journal (jnl_flush);
+ * dados: MAP_SHARED – gravados em write-back pelo kernel                */
+static int _mount(const char *path, uint64_t file_size)
+{
+    char *jpath = g_strconcat(path, ".jnl", NULL);
+    int   rc    = jnl_replay(jpath, _fd) < 0 ? -1 : 0;
+
+    VolSuper sb;
+    if (rc == 0 &&
+        (pread(_fd, &sb, sizeof sb, 0) != (ssize_t)sizeof sb ||
+         !_valid_super(&sb, file_size))) {
+        fputs("volume: superbloco inválido\n", stderr);
+        rc = -1;
+    }
+    if (rc == 0) {
+        _len  = sb.data_off;
+        _dlen = sb.image_size - sb.data_off;
+        _map  = mmap(NULL, _len, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0);
+        _data = mmap(NULL, _dlen, PROT_READ | PROT_WRITE, MAP_SHARED, _fd,
+                     (off_t)sb.data_off);
+        if (_map == MAP_FAILED)  _map  = NULL;
+        if (_data == MAP_FAILED) _data = NULL;
+        rc = _map && _data ? jnl_open(jpath, _fd, _map, _len) : -1;
+    }
+    g_free(jpath);
+    if (rc) return -1;
+
+    _sb = (VolSuper *)_map;
+    if (!_sb->clean)
+        fputs("volume: imagem não foi desmontada corretamente\n", stderr);
+    return 0;
+}
+
+static int _sync_data(void) { return msync(_data, _dlen, MS_SYNC); }
+
+int vol_open(const char *path, size_t nblocks, size_t block_sz)
+{
+    if (_map || !path) return -1;
+    _fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) { perror(path); return -1; }
+
+    struct stat st;
+    int rc = fstat(_fd, &st) ? -1
+           : st.st_size == 0 && _format(nblocks, block_sz) ? -1
+           : fstat(_fd, &st) ? -1
+           : _mount(path, (uint64_t)st.st_size);
+    if (rc == 0) {
+        jnl_set_commit_hooks(_sync_data, block_release_pending);
+        jnl_begin();
+        rc = block_attach(_data,
+                          (uint64_t *)(_map + _sb->bitmap_off),
+                          (uint32_t *)(_map + _sb->ref_off),
+                          _sb->capacity, _sb->block_size, !_sb->clean);
+        _sb->clean = 0;
+        LOG(_sb->clean);
+        jnl_end();
+        if (rc == 0) rc = jnl_flush();               /* "sujo" já durável */
+    }
+    if (rc) {
+        jnl_close();
+        if (_map)  munmap(_map, _len);
+        if (_data) munmap(_data, _dlen);
+        close(_fd);
+        _map = _data = NULL; _fd = -1;
+        return -1;
+    }
+
+    _itab  = (VolInode *)(_map + _sb->itab_off);
+    _ifree = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    for (uint32_t i = _sb->inode_hwm; i-- > 1; )      /* topo = menor slot */
+        if (_itab[i].kind == VI_FREE) g_array_append_val(_ifree, i);
+    return 0;
+}
+
+/* dados em disco, metadados aplicados pelo journal e diário truncado */
+int vol_sync(void)
+{
+    if (!_map) return 0;
+    return _sync_data() || jnl_checkpoint() ? -1 : 0;
+}
+
+void vol_close(void)
+{
+    if (!_map) return;
+    jnl_flush();                                  /* solta blocos adiados */
+    block_release_pending();
+    block_flush_caches();                         /* magazines → bitmap   */
+    jnl_begin();
+    _sb->clean = 1;
+    LOG(_sb->clean);
+    jnl_end();
+    _sync_data();
+    jnl_close();                                  /* checkpoint final     */
+    munmap(_map, _len);
+    munmap(_data, _dlen);
+    close(_fd);
+    g_array_free(_ifree, TRUE);
+    _map = _data = NULL; _sb = NULL; _itab = NULL; _ifree = NULL; _fd = -1;
+}
+
+bool vol_active(void) { return _map != NULL; }
+
+/*──────────────── tabela de inodes ────────────────────────*/
+uint32_t vol_ialloc(void)
+{
+    uint32_t ino = VOL_NO_INODE;
+    g_mutex_lock(&_ilock);
+    if (_ifree->len) {
+        ino = g_array_index(_ifree, uint32_t, _ifree->len - 1);
+        g_array_set_size(_ifree, _ifree->len - 1);
+    } else if (_sb->inode_hwm < _sb->ninodes) {
+        ino = _sb->inode_hwm++;
+        LOG(_sb->inode_hwm);
+    }
+    g_mutex_unlock(&_ilock);
+    if (ino == VOL_NO_INODE) return ino;
+    memset(&_itab[ino], 0, sizeof *_itab);
+    _itab[ino].ext_blk = VOL_NO_BLOCK;
+    LOG(_itab[ino]);
+    return ino;
+}
+
+void vol_ifree(uint32_t ino)
+{
+    if (!_map || ino == VOL_ROOT_INO || ino >= _sb->inode_hwm) return;
+    _chain_free(_itab[ino].ext_blk);
+    memset(&_itab[ino], 0, sizeof *_itab);
+    LOG(_itab[ino]);
+    g_mutex_lock(&_ilock);
+    g_array_append_val(_ifree, ino);
+    g_mutex_unlock(&_ilock);
+}
+
+uint32_t vol_inode_hwm(void) { return _map ? _sb->inode_hwm : 0; }
+
+const VolInode *vol_inode(uint32_t ino)
+{
+    return (_map && ino < _sb->inode_hwm) ? &_itab[ino] : NULL;
+}
+
+/*──────────────── write-through ───────────────────────────*/
+static void _put_name(VolInode *vi, const char *name)
+{
+    memset(vi->name, 0, sizeof vi->name);
+    g_strlcpy(vi->name, name, sizeof vi->name);
+}
+
+void vol_put_dir(const Dir *d)
+{
+    if (!_map || d->ino >= _sb->inode_hwm) return;
+    VolInode *vi = &_itab[d->ino];
+    vi->kind   = VI_DIR;
+    vi->perms  = d->perms;
+    vi->parent = d->parent ? d->parent->ino : VOL_ROOT_INO;
+    vi->owner  = d->owner;
+    vi->group  = d->group;
+    _put_name(vi, d->name);
+    LOG(*vi);
+}
+
+/* regrava a lista de extents: primeiros no inode, resto numa cadeia nova
+ * de blocos (a antiga só é solta depois que a nova está pronta)        */
+static int _put_extents(VolInode *vi, const GArray *ex)
+{
+    uint32_t n      = ex->len;
+    uint32_t inl    = MIN(n, (uint32_t)VOL_EXT_INLINE);
+    uint32_t old    = vi->ext_blk;
+    uint32_t head   = VOL_NO_BLOCK, *link = &head;
+    size_t   per    = _ext_per_block();
+
+    for (uint32_t i = inl; i < n; ) {
+        int b = block_alloc();
+        if (b < 0) { _chain_free(head); return -1; }
+        ExtBlock *eb = _eb((uint32_t)b);
+        eb->count = (uint32_t)MIN(per, (size_t)(n - i));
+        eb->next  = VOL_NO_BLOCK;
+        memcpy(eb->ext, &g_array_index(ex, Extent, i), eb->count * sizeof(Extent));
+        *link = (uint32_t)b; link = &eb->next;
+        i += eb->count;
+    }
+
+    memset(vi->ext, 0, sizeof vi->ext);
+    memcpy(vi->ext, ex->data, inl * sizeof(Extent));
+    vi->nextents = n;
+    vi->ext_blk  = head;
+    _chain_free(old);
+    return 0;
+}
+
+int vol_put_file(const FCB *f, uint32_t parent, bool extents)
+{
+    if (!_map || f->inode >= _sb->inode_hwm) return 0;
+    VolInode *vi = &_itab[f->inode];
+    vi->kind     = VI_FILE;
+    vi->perms    = f->perms;
+    vi->parent   = parent;
+    vi->owner    = f->owner;
+    vi->group    = f->group;
+    vi->ftype    = f->type;
+    vi->size     = f->size;
+    vi->created  = f->created;
+    vi->modified = f->modified;
+    vi->accessed = f->accessed;
+    vi->flags    = f->zip ? vi->flags | VI_F_ZIP : vi->flags & ~VI_F_ZIP;
+    _put_name(vi, f->name);
+    LOG(*vi);
+    if (!f->extents) {                        /* inline: os bytes vão junto */
+        if (!(vi->flags & VI_F_INLINE)) {
+            _chain_free(vi->ext_blk);
+            vi->ext_blk  = VOL_NO_BLOCK;
+            vi->nextents = 0;
+            vi->flags   |= VI_F_INLINE;
+        }
+        memset(vi->data, 0, sizeof vi->data);
+        memcpy(vi->data, f->inl, MIN(f->size, sizeof f->inl));
+        return 0;
+    }
+    if (vi->flags & VI_F_INLINE) {            /* promovido a blocos */
+        vi->flags &= ~VI_F_INLINE;
+        memset(vi->data, 0, sizeof vi->data);
+        extents = true;
+    }
+    vi->tail_blk = f->tail_blk;
+    vi->tail_off = f->tail_off;
+    vi->tail_cap = f->tail_cap;
+    return extents ? _put_extents(vi, f->extents) : 0;
+}
+
+int vol_get_extents(uint32_t ino, GArray *out)
+{
+    const VolInode *vi = vol_inode(ino);
+    if (!vi) return -1;
+    if (vi->flags & VI_F_INLINE) return 0;
+    uint32_t inl = MIN(vi->nextents, (uint32_t)VOL_EXT_INLINE);
+    g_array_append_vals(out, vi->ext, inl);
+    for (uint32_t b = vi->ext_blk; b != VOL_NO_BLOCK; b = _eb(b)->next)
+        g_array_append_vals(out, _eb(b)->ext, _eb(b)->count);
+    return out->len == vi->nextents ? 0 : -1;
+}
@@ -0,0 +1,73 @@
+#ifndef CHECK_H
+#define CHECK_H
+/*─────────────────────────────────────────────────────────────*/
+/*  Mini-harness dos testes (make check)                       */
+/*                                                             */
+/*  Cada tests/test_*.c vira um binário ligado aos objetos do  */
+/*  mfs. CHECK aborta o teste com arquivo:linha; a saída ≠ 0   */
+/*  derruba o `make check`. fs_shutdown só desmonta o volume   */
+/*  (a árvore de pastas e os FCBs ficam no processo), então    */
+/*  cada montagem roda num processo filho (check_run).         */
+/*─────────────────────────────────────────────────────────────*/
+#include "auth.h"
+#include "fs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define CHECK(c)                                                          \
+    do { if (!(c)) {                                                      \
+        fprintf(stderr, "%s:%d: falhou: %s\n", __FILE__, __LINE__, #c);   \
+        exit(1);                                                          \
+    } } while (0)
+
+static char check_dir[] = "/tmp/mfs-check-XXXXXX";
+
+/* pasta temporária vira o cwd (users.db/groups.db e as imagens) e o
+ * processo roda como root: os testes não passam pelas permissões    */
+static inline void check_init(void)
+{
+    CHECK(mkdtemp(check_dir) && chdir(check_dir) == 0);
+    auth_init();
+    auth_set_uid(0); auth_set_gid(0);
+}
+
+/* apaga as imagens e a pasta; chamado no fim de main */
+static inline int check_done(const char *name)
+{
+    char cmd[64];
+    snprintf(cmd, sizeof cmd, "rm -rf %s", check_dir);
+    if (system(cmd)) fprintf(stderr, "%s: não apagou %s\n", name, check_dir);
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+/* fn num processo novo (uma montagem); o teste para se o filho falhar */
+static inline void check_run(void (*fn)(void))
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (!pid) { fn(); fflush(NULL); _exit(0); }
+    int st;
+    CHECK(waitpid(pid, &st, 0) == pid);
+    if (!WIFEXITED(st) || WEXITSTATUS(st)) exit(1);
+}
+
+/* n bytes iguais a c em [off, off+n) de path (e o tamanho ≥ off+n) */
+static inline void check_fill(const char *path, size_t off, size_t n, char c)
+{
+    char  *buf = malloc(n ? n : 1);
+    CHECK(buf && fs_pread(path, buf, n, off) == (ssize_t)n);
+    for (size_t i = 0; i < n; ++i)
+        if (buf[i] != c) {
+            fprintf(stderr, "%s: byte %zu = 0x%02x, esperado '%c'\n",
+                    path, off + i, (unsigned char)buf[i], c);
+            exit(1);
+        }
+    free(buf);
+}
+
+#endif /* CHECK_H */
@@ -0,0 +1,46 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Grupos entre sessões: o que uma sessão muda no banco vale  */
+/*  na próxima checagem das outras, inclusive no X em cache    */
+/*  da resolução de caminhos.                                  */
+/*─────────────────────────────────────────────────────────────*/
+#include "check.h"
+#include "session.h"
+
+enum { UID = 3901, GID = 3900 };
+
+/* /d é de root:GID com 0710; só quem está em GID atravessa */
+static bool _through(Session *s)
+{
+    Session *old = session_use(s);
+    bool ok = dir_resolve(NULL, "/d") != NULL &&
+              auth_has_perm_mode(0, GID, 0070, P_READ);
+    session_use(old);
+    return ok;
+}
+
+static void _other_session(void)
+{
+    CHECK(fs_init(NULL, 64, 4096, 0) == 0);
+    CHECK(auth_groupadd("dv", GID, 0) == 0);
+    CHECK(auth_useradd("ana", UID, 1000, "x", 0664) == 0);
+    auth_set_gid(GID);
+    CHECK(dir_mkdir("/d") == 0);
+    dir_resolve(NULL, "/d")->perms = 0710;
+    dir_invalidate();
+    auth_set_gid(0);
+
+    Session *ana = session_new(UID, 1000);
+    CHECK(!_through(ana));                          /* X negado fica em cache */
+    CHECK(auth_add_user_to_group("ana", "dv") == 0);   /* pela sessão do admin */
+    CHECK(_through(ana));
+    CHECK(auth_delete_user("ana") == 0);
+    CHECK(!_through(ana));
+    session_free(ana);
+}
+
+int main(void)
+{
+    check_init();
+    check_run(_other_session);
+    return check_done("test_auth");
+}
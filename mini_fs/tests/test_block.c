@@ -0,0 +1,94 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Alocador com o volume quase cheio: os blocos guardados nas */
+/*  magazines contam como livres e precisam ser alcançáveis    */
+/*  por faixas, inclusive os da magazine de outra thread.      */
+/*─────────────────────────────────────────────────────────────*/
+#include "check.h"
+#include "block.h"
+#include <glib.h>
+
+#define NBLK 16
+
+/* a magazine da thread principal fica com quase tudo; outra thread
+ * pede faixas até esgotar o volume                                 */
+static gpointer _ranges(gpointer p)
+{
+    size_t total = 0, got;
+    int    b;
+    while ((b = block_alloc_range(NBLK, &got)) >= 0) total += got;
+    CHECK(block_alloc() < 0 && block_free_count() == 0);
+    *(size_t *)p = total;
+    return NULL;
+}
+
+static void _other_thread(void)
+{
+    CHECK(block_init(NBLK, 512, 0) == 0);
+    CHECK(block_free_count() == NBLK);
+    int a = block_alloc();                 /* o refill leva o resto junto */
+    CHECK(a >= 0 && block_free_count() == NBLK - 1);
+    size_t total = 0;
+    g_thread_join(g_thread_new("ranges", _ranges, &total));
+    CHECK(total == NBLK - 1);
+    for (int i = 0; i < NBLK; ++i) block_free(i);
+    CHECK(block_free_count() == NBLK);
+}
+
+/* 300 B num arquivo e 700 B noutro (2 blocos) com 15 livres */
+static void _fs_small(void)
+{
+    char buf[700];
+    memset(buf, 'x', sizeof buf);
+    CHECK(fs_init(NULL, NBLK, 512, 0) == 0);
+    CHECK(fs_touch("a") == 0 && fs_pwrite("a", buf, 300, 0) == 300);
+    CHECK(fs_touch("b") == 0 && fs_pwrite("b", buf, 700, 0) == 700);
+    check_fill("a", 0, 300, 'x');
+    check_fill("b", 0, 700, 'x');
+}
+
+/* o que block_free_count diz que cabe, fallocate consegue reservar */
+static void _fs_fill(void)
+{
+    CHECK(fs_init(NULL, NBLK, 512, 0) == 0);
+    CHECK(fs_touch("a") == 0 && fs_pwrite("a", "x", 1, 0) == 1);
+    CHECK(fs_touch("c") == 0);
+    CHECK(fs_fallocate("c", 0, block_free_count() * 512) == 0);
+    CHECK(block_free_count() == 0);
+}
+
+/* contêiner de comprimidos (BLOCK_ZRUN blocos seguidos) com o bitmap
+ * picotado: depois da dica da busca só há blocos livres isolados, e a
+ * única faixa que serve fica no começo                                */
+static void _frag_scan(void)
+{
+    enum { N = 256, RUN = 8 };
+    char buf[512];
+    CHECK(block_init(N, 512, 0) == 0);
+    size_t got;
+    for (size_t n = 0; n < N; n += got) CHECK(block_alloc_range(N - n, &got) >= 0);
+    CHECK(block_free_count() == 0);
+    for (int i = 56; i < N; i += 2) block_free(i);
+    for (int i = RUN; i < RUN + BLOCK_ZRUN; ++i) block_free(i);
+    block_flush_caches();
+    size_t before = block_free_count();
+
+    memset(buf, 'z', sizeof buf);
+    CHECK(block_write(1, buf, sizeof buf, 0) == sizeof buf);
+    uint32_t id = block_zpack(1);
+    CHECK(id & BLOCK_Z);
+    CHECK(block_free_count() == before - BLOCK_ZRUN);  /* nada preso no caminho */
+    memset(buf, 0, sizeof buf);
+    CHECK(block_zread(id, buf, sizeof buf, 0) == sizeof buf && buf[0] == 'z' && buf[511] == 'z');
+    block_zfree(id);
+    CHECK(block_free_count() == before);
+}
+
+int main(void)
+{
+    check_init();
+    check_run(_other_thread);
+    check_run(_fs_small);
+    check_run(_fs_fill);
+    check_run(_frag_scan);
+    return check_done("test_block");
+}
@@ -0,0 +1,52 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Diário: uma escrita na imagem que falha (aqui, descritor   */
+/*  só de leitura) nunca esvazia o diário – nem no checkpoint  */
+/*  nem no replay da montagem.                                 */
+/*─────────────────────────────────────────────────────────────*/
+#include "check.h"
+#include "journal.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define IMG "jnl.img"
+#define JNL "jnl.img.jnl"
+
+static off_t _jsize(void)
+{
+    struct stat st;
+    CHECK(stat(JNL, &st) == 0);
+    return st.st_size;
+}
+
+static void _image_fails(void)
+{
+    static uint8_t meta[4 * JNL_LINE];
+    int rw = open(IMG, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    CHECK(rw >= 0 && ftruncate(rw, sizeof meta) == 0);
+    int ro = open(IMG, O_RDONLY);
+    CHECK(ro >= 0);
+
+    /* lote gravado no diário; a aplicação na imagem falha */
+    CHECK(jnl_open(JNL, ro, meta, sizeof meta) == 0);
+    jnl_begin();
+    memset(meta + JNL_LINE, 'm', 8);
+    jnl_log(meta + JNL_LINE, 8);
+    jnl_end();
+    CHECK(jnl_flush() == 0);
+    CHECK(jnl_checkpoint() < 0 && _jsize() > 0);
+    jnl_close();
+    CHECK(_jsize() > 0);
+
+    CHECK(jnl_replay(JNL, ro) < 0 && _jsize() > 0);     /* de novo no replay */
+    CHECK(jnl_replay(JNL, rw) == 1 && _jsize() == 0);
+    char c;
+    CHECK(pread(rw, &c, 1, JNL_LINE) == 1 && c == 'm');
+    close(ro); close(rw);
+}
+
+int main(void)
+{
+    check_init();
+    check_run(_image_fails);
+    return check_done("test_journal");
+}
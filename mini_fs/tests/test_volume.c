@@ -0,0 +1,110 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Ida e volta pela imagem: o que uma montagem grava, a       */
+/*  seguinte lê igual, e nenhum bloco fica com dois donos.     */
+/*─────────────────────────────────────────────────────────────*/
+#include "check.h"
+#include "block.h"
+
+static const char *_img = "vol.img";
+
+static void _mount(size_t nblocks) { CHECK(fs_init(_img, nblocks, BLOCK_SIZE_DFLT, 0) == 0); }
+
+/* n cópias de c por echo (> ou >>); devolve o rc de fs_echo */
+static int _echo(const char *path, size_t n, char c, int append)
+{
+    char *txt = malloc(n + 1);
+    CHECK(txt);
+    memset(txt, c, n); txt[n] = '\0';
+    int rc = fs_echo(path, txt, append);
+    free(txt);
+    return rc;
+}
+
+static void _size(const char *path, size_t n)
+{
+    char c;
+    CHECK(fs_pread(path, &c, 1, n) == 0 && (!n || fs_pread(path, &c, 1, n - 1) == 1));
+}
+
+/*──────────────── tamanhos variados ───────────────────────*/
+/* inline, cauda em fragmento, blocos + cauda, esparso e truncado */
+static void _mixed_1(void)
+{
+    _mount(256);
+    CHECK(_echo("inl",  50,   'i', 0) == 50);
+    CHECK(_echo("tail", 1500, 't', 0) == 1500);
+    CHECK(_echo("big",  9000, 'b', 0) == 9000);
+    CHECK(fs_touch("sp") == 0 && fs_pwrite("sp", "s", 1, 20000) == 1);
+    CHECK(_echo("tr",   12000, 'r', 0) == 12000 && fs_truncate("tr", 5000) == 0);
+    fs_shutdown();
+}
+
+static void _mixed_2(void)
+{
+    _mount(0);
+    check_fill("inl", 0, 50, 'i');     _size("inl", 50);
+    check_fill("tail", 0, 1500, 't');  _size("tail", 1500);
+    check_fill("big", 0, 9000, 'b');   _size("big", 9000);
+    check_fill("sp", 0, 20000, '\0');  check_fill("sp", 20000, 1, 's');
+    check_fill("tr", 0, 5000, 'r');    _size("tr", 5000);
+    CHECK(_echo("inl",  200, 'I', 1) == 200);                 /* sai do inode */
+    CHECK(_echo("tail", 3000, 'T', 1) == 3000);               /* cauda cresce */
+    CHECK(_echo("big",  100, 'B', 0) == 100);                 /* encolhe      */
+    fs_shutdown();
+}
+
+static void _mixed_3(void)
+{
+    _mount(0);
+    check_fill("inl", 0, 50, 'i');     check_fill("inl", 50, 200, 'I');   _size("inl", 250);
+    check_fill("tail", 0, 1500, 't');  check_fill("tail", 1500, 3000, 'T');
+    check_fill("big", 0, 100, 'B');    _size("big", 100);
+    fs_shutdown();
+}
+
+/*──────────────── echo que encolhe ────────────────────────*/
+/* echo sem >> encolhe f antes de escrever: os blocos soltos não podem
+ * ficar no mapa gravado, senão h* os recebem depois da remontagem e o
+ * anexo seguinte em f escreve por cima deles                          */
+static void _shrink_1(void)
+{
+    _mount(16);
+    CHECK(_echo("f", 11000, 'f', 0) == 11000);
+    CHECK(_echo("f", 7000,  'f', 0) == 7000);
+    fs_shutdown();
+}
+
+static void _shrink_2(void)
+{
+    _mount(0);
+    for (int i = 1; i <= 7; ++i) {                  /* até acabar o espaço */
+        char n[8];
+        snprintf(n, sizeof n, "h%d", i);
+        _echo(n, 7000, 'h', 0);
+    }
+    fs_shutdown();
+}
+
+static void _shrink_3(void)
+{
+    _mount(0);
+    int rc = _echo("f", 3000, 'F', 1);                    /* volume cheio? */
+    check_fill("f", 0, 7000, 'f');
+    if (rc == 3000) check_fill("f", 7000, 3000, 'F');
+    else            _size("f", 7000);
+    for (int i = 1; i <= 7; ++i) {
+        char n[8], c;
+        snprintf(n, sizeof n, "h%d", i);
+        if (fs_pread(n, &c, 1, 0) == 1) check_fill(n, 0, 7000, 'h');
+    }
+    fs_shutdown();
+}
+
+int main(void)
+{
+    check_init();
+    check_run(_mixed_1); check_run(_mixed_2); check_run(_mixed_3);
+    unlink(_img); unlink("vol.img.jnl");
+    check_run(_shrink_1); check_run(_shrink_2); check_run(_shrink_3);
+    return check_done("test_volume");
+}
@@ -0,0 +1,146 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Blocos comprimidos: ida e volta pela imagem, fragmento     */
+/*  corrompido e leituras em paralelo pelo cache.              */
+/*─────────────────────────────────────────────────────────────*/
+#include "check.h"
+#include "block.h"
+#include "session.h"
+#include <glib.h>
+
+#define BS    BLOCK_SIZE_DFLT
+#define NZ    8                         /* blocos por arquivo          */
+
+static const char *_img = "zip.img";
+
+/* linhas de log: comprime ~3x; o byte em `i` depende só de i e do seed */
+static void _gen(char *buf, size_t n, unsigned seed)
+{
+    size_t i = 0;
+    while (i < n) {
+        char line[80];
+        int  k = snprintf(line, sizeof line, "%06u GET /api/item/%u status=200\n",
+                          (unsigned)(i / 40) + seed, (unsigned)(i / 40 % 97));
+        for (int j = 0; j < k && i < n; ++j) buf[i++] = line[j];
+    }
+}
+
+static void _same(const char *path, size_t off, size_t n, unsigned seed)
+{
+    char *want = malloc(off + n), *got = malloc(n);
+    CHECK(want && got);
+    _gen(want, off + n, seed);
+    CHECK(fs_pread(path, got, n, off) == (ssize_t)n);
+    CHECK(memcmp(want + off, got, n) == 0);
+    free(want); free(got);
+}
+
+static void _write(const char *path, size_t n, unsigned seed)
+{
+    char *buf = malloc(n);
+    CHECK(buf);
+    _gen(buf, n, seed);
+    CHECK(fs_touch(path) == 0 && fs_pwrite(path, buf, n, 0) == (ssize_t)n);
+    free(buf);
+}
+
+/*──────────────── remontagem ──────────────────────────────*/
+static void _zip_1(void)
+{
+    CHECK(fs_init(_img, 256, BS, FS_F_ZIP) == 0);
+    size_t before = block_free_count();
+    _write("z", NZ * BS + 100, 1);
+    CHECK(fs_sync() == 0);                        /* solta os adiados */
+    CHECK(before - block_free_count() < NZ);      /* algo comprimiu   */
+    _write("p", NZ * BS, 2);
+    CHECK(fs_compress("p", true) == 0);
+    CHECK(fs_cp("z", "c") == 0);
+    fs_shutdown();
+}
+
+static void _zip_2(void)
+{
+    CHECK(fs_init(_img, 0, 0, 0) == 0);
+    _same("z", 0, NZ * BS + 100, 1);
+    _same("p", 0, NZ * BS, 2);
+    _same("c", 0, NZ * BS + 100, 1);
+    CHECK(fs_pwrite("z", "X", 1, 3 * BS + 7) == 1);   /* descomprime um */
+    CHECK(fs_truncate("p", 2 * BS + 5) == 0);
+    CHECK(fs_compress("c", false) == 0);
+    fs_shutdown();
+}
+
+static void _zip_3(void)
+{
+    CHECK(fs_init(_img, 0, 0, 0) == 0);
+    _same("z", 0, 3 * BS + 7, 1);
+    _same("z", 3 * BS + 8, NZ * BS + 100 - (3 * BS + 8), 1);
+    check_fill("z", 3 * BS + 7, 1, 'X');
+    _same("p", 0, 2 * BS + 5, 2);
+    _same("c", 0, NZ * BS + 100, 1);
+    CHECK(fs_rm("z") == 0 && fs_rm("p") == 0 && fs_rm("c") == 0);
+    fs_shutdown();
+}
+
+/*──────────────── fragmento corrompido ────────────────────*/
+/* a leitura de um bloco que não descomprime falha (pread, cat, sendfile,
+ * read_iov); nada de buffer com lixo nem saída cortada com rc 0      */
+static void _corrupt(void)
+{
+    CHECK(fs_init(NULL, 64, BS, FS_F_ZIP) == 0);
+    _write("z", 3 * BS, 3);
+    char junk[BS];
+    memset(junk, 0xff, sizeof junk);
+    for (int b = 0; b < 64; ++b)                  /* contêiner inclusive */
+        if (block_refcount(b)) block_write(b, junk, sizeof junk, 0);
+    char buf[BS];
+    CHECK(fs_pread("z", buf, sizeof buf, 0) < 0);
+
+    FILE *null = fopen("/dev/null", "w");
+    CHECK(null);
+    session_current()->out = null;                /* cat pela saída da sessão */
+    CHECK(fs_cat("z") < 0);
+    CHECK(fs_sendfile(fileno(null), "z", 0, 3 * BS) < 0);
+    CHECK(fs_sendfile(fileno(null), "z", 3 * BS, BS) == 0);      /* EOF segue 0 */
+    struct iovec iov[4];
+    size_t got;
+    CHECK(fs_read_iov("z", 0, 3 * BS, iov, 4, &got) < 0);
+    fclose(null);
+}
+
+/*──────────────── leitores em paralelo ────────────────────*/
+#define READERS 4
+#define NFILES  (READERS * 2)              /* > BLOCK_ZCACHE blocos no total */
+
+static gpointer _reader(gpointer p)
+{
+    unsigned t = GPOINTER_TO_UINT(p);
+    for (int round = 0; round < 20; ++round)
+        for (unsigned i = 0; i < NFILES; ++i) {
+            char n[8];
+            snprintf(n, sizeof n, "r%u", (i + t) % NFILES);
+            _same(n, 0, NZ * BS, (i + t) % NFILES + 10);
+        }
+    return NULL;
+}
+
+static void _parallel(void)
+{
+    CHECK(fs_init(NULL, 1024, BS, FS_F_ZIP) == 0);
+    for (unsigned i = 0; i < NFILES; ++i) {
+        char n[8];
+        snprintf(n, sizeof n, "r%u", i);
+        _write(n, NZ * BS, i + 10);
+    }
+    GThread *th[READERS];
+    for (unsigned t = 0; t < READERS; ++t) th[t] = g_thread_new("rd", _reader, GUINT_TO_POINTER(t));
+    for (unsigned t = 0; t < READERS; ++t) g_thread_join(th[t]);
+}
+
+int main(void)
+{
+    check_init();
+    check_run(_zip_1); check_run(_zip_2); check_run(_zip_3);
+    check_run(_corrupt);
+    check_run(_parallel);
+    return check_done("test_zip");
+}
@@ -0,0 +1,48 @@
+/*─────────────────────────────────────────────────────────────*/
+/*  Gera shell_hash.h: hash perfeito dos nomes de comando      */
+/*                                                             */
+/*  Procura a menor semente para a qual shell_hash() não       */
+/*  colide numa tabela 2^bits ≥ 2·n; cada slot guarda o        */
+/*  índice do comando em SHELL_COMMANDS ou −1.                 */
+/*─────────────────────────────────────────────────────────────*/
+#include "shell_cmds.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NAME(n, ...) #n,
+static const char *names[] = { SHELL_COMMANDS(NAME) };
+#define NCMDS ((int)(sizeof names / sizeof *names))
+
+int main(void)
+{
+    unsigned bits = 1;
+    while ((1u << bits) < 2u * NCMDS) ++bits;
+
+    for (;; ++bits) {
+        unsigned size = 1u << bits, mask = size - 1;
+        signed char slot[256];
+        for (uint32_t seed = 0; seed < 1000000; ++seed) {
+            memset(slot, -1, size);
+            int i;
+            for (i = 0; i < NCMDS; ++i) {
+                unsigned h = shell_hash(names[i], seed) & mask;
+                if (slot[h] >= 0) break;
+                slot[h] = (signed char)i;
+            }
+            if (i < NCMDS) continue;
+
+            printf("/* gerado por tools/mkcmdhash.c – não editar */\n"
+                   "#define SHELL_HASH_SEED  0x%08xu\n"
+                   "#define SHELL_HASH_MASK  0x%xu\n"
+                   "static const signed char shell_slot[%u] = {",
+                   (unsigned)seed, mask, size);
+            for (unsigned k = 0; k < size; ++k)
+                printf("%s%d,", k % 16 ? " " : "\n    ", slot[k]);
+            printf("\n};\n");
+            return 0;
+        }
+        if (bits == 8) break;
+    }
+    fputs("mkcmdhash: nenhuma semente sem colisão\n", stderr);
+    return 1;
+}